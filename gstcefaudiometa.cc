@@ -6,6 +6,7 @@ gst_cef_audio_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
   GstCefAudioMeta *ameta = (GstCefAudioMeta *) meta;
 
   ameta->buffers = NULL;
+  ameta->pts = GST_CLOCK_TIME_NONE;
 
   return TRUE;
 }
@@ -21,6 +22,122 @@ gst_cef_audio_meta_free (GstMeta * meta, GstBuffer * buffer)
   }
 }
 
+/* The audio does not depend on the video content, so every transform
+ * shares it, which also keeps it through gst_buffer_copy() and tee */
+static gboolean
+gst_cef_audio_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstCefAudioMeta *ameta = (GstCefAudioMeta *) meta;
+
+  if (!ameta->buffers)
+    return TRUE;
+
+  gst_buffer_add_cef_audio_meta (dest, gst_buffer_list_ref (ameta->buffers))->pts = ameta->pts;
+
+  return TRUE;
+}
+
+#if GST_CHECK_VERSION(1, 24, 0)
+/* The number of audio buffers and the meta PTS, then per audio buffer:
+ * PTS, duration, flags and size, followed by the samples. Lets the audio
+ * cross process boundaries along with the video, e.g. through
+ * unixfdsink. */
+#define AUDIO_META_HEADER_SIZE (4 + 8)
+#define AUDIO_BUFFER_HEADER_SIZE (8 + 8 + 4 + 4)
+
+static gboolean
+gst_cef_audio_meta_serialize (const GstMeta * meta, GstByteArrayInterface * data,
+    guint8 * version)
+{
+  GstCefAudioMeta *ameta = (GstCefAudioMeta *) meta;
+  guint i, n = ameta->buffers ? gst_buffer_list_length (ameta->buffers) : 0;
+  guint8 header[AUDIO_BUFFER_HEADER_SIZE];
+
+  GST_WRITE_UINT32_LE (header, n);
+  GST_WRITE_UINT64_LE (header + 4, ameta->pts);
+  if (!gst_byte_array_interface_append_data (data, header, AUDIO_META_HEADER_SIZE))
+    return FALSE;
+
+  for (i = 0; i < n; i++) {
+    GstBuffer *buf = gst_buffer_list_get (ameta->buffers, i);
+    GstMapInfo info;
+    gboolean ret;
+
+    if (!gst_buffer_map (buf, &info, GST_MAP_READ))
+      return FALSE;
+
+    GST_WRITE_UINT64_LE (header, GST_BUFFER_PTS (buf));
+    GST_WRITE_UINT64_LE (header + 8, GST_BUFFER_DURATION (buf));
+    GST_WRITE_UINT32_LE (header + 16, GST_BUFFER_FLAGS (buf));
+    GST_WRITE_UINT32_LE (header + 20, info.size);
+
+    ret = gst_byte_array_interface_append_data (data, header, AUDIO_BUFFER_HEADER_SIZE) &&
+        gst_byte_array_interface_append_data (data, info.data, info.size);
+    gst_buffer_unmap (buf, &info);
+
+    if (!ret)
+      return FALSE;
+  }
+
+  *version = 1;
+
+  return TRUE;
+}
+
+static GstMeta *
+gst_cef_audio_meta_deserialize (const GstMetaInfo * info, GstBuffer * buffer,
+    const guint8 * data, gsize size, guint8 version)
+{
+  GstCefAudioMeta *ameta;
+  GstBufferList *buffers;
+  GstClockTime pts;
+  guint i, n;
+
+  if (version != 1 || size < AUDIO_META_HEADER_SIZE)
+    return NULL;
+
+  n = GST_READ_UINT32_LE (data);
+  pts = GST_READ_UINT64_LE (data + 4);
+  data += AUDIO_META_HEADER_SIZE;
+  size -= AUDIO_META_HEADER_SIZE;
+
+  if (n > size / AUDIO_BUFFER_HEADER_SIZE)
+    return NULL;
+
+  buffers = gst_buffer_list_new_sized (n);
+  for (i = 0; i < n; i++) {
+    GstBuffer *buf;
+    guint32 buf_size;
+
+    if (size < AUDIO_BUFFER_HEADER_SIZE)
+      goto invalid;
+
+    buf_size = GST_READ_UINT32_LE (data + 20);
+    if (size - AUDIO_BUFFER_HEADER_SIZE < buf_size)
+      goto invalid;
+
+    buf = gst_buffer_new_memdup (data + AUDIO_BUFFER_HEADER_SIZE, buf_size);
+    GST_BUFFER_PTS (buf) = GST_READ_UINT64_LE (data);
+    GST_BUFFER_DURATION (buf) = GST_READ_UINT64_LE (data + 8);
+    GST_BUFFER_FLAGS (buf) = GST_READ_UINT32_LE (data + 16);
+    gst_buffer_list_add (buffers, buf);
+
+    data += AUDIO_BUFFER_HEADER_SIZE + buf_size;
+    size -= AUDIO_BUFFER_HEADER_SIZE + buf_size;
+  }
+
+  ameta = gst_buffer_add_cef_audio_meta (buffer, buffers);
+  ameta->pts = pts;
+
+  return (GstMeta *) ameta;
+
+invalid:
+  gst_buffer_list_unref (buffers);
+  return NULL;
+}
+#endif
+
 GstCefAudioMeta *
 gst_buffer_add_cef_audio_meta (GstBuffer * buffer, GstBufferList *buffers)
 {
@@ -53,11 +170,24 @@ gst_cef_audio_meta_get_info (void)
   static const GstMetaInfo *gst_cef_audio_meta_info = NULL;
 
   if (g_once_init_enter ((GstMetaInfo **) &gst_cef_audio_meta_info)) {
+#if GST_CHECK_VERSION(1, 24, 0)
+    GstMetaInfo *info = gst_meta_info_new (GST_CEF_AUDIO_META_API_TYPE,
+        "GstCefAudioMeta", sizeof (GstCefAudioMeta));
+    const GstMetaInfo *meta;
+
+    info->init_func = gst_cef_audio_meta_init;
+    info->free_func = gst_cef_audio_meta_free;
+    info->transform_func = gst_cef_audio_meta_transform;
+    info->serialize_func = gst_cef_audio_meta_serialize;
+    info->deserialize_func = gst_cef_audio_meta_deserialize;
+    meta = gst_meta_info_register (info);
+#else
     const GstMetaInfo *meta =
         gst_meta_register (GST_CEF_AUDIO_META_API_TYPE,
         "GstCefAudioMeta", sizeof (GstCefAudioMeta),
         gst_cef_audio_meta_init, gst_cef_audio_meta_free,
-        NULL);
+        gst_cef_audio_meta_transform);
+#endif
     g_once_init_leave ((GstMetaInfo **) &gst_cef_audio_meta_info,
         (GstMetaInfo *) meta);
   }
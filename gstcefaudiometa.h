@@ -20,7 +20,13 @@ typedef struct _GstCefAudioMeta GstCefAudioMeta;
 
 struct _GstCefAudioMeta {
   GstMeta      meta;
+  /* Audio packets received since the previous frame, timestamped with
+   * the running time their CEF timestamp maps to */
   GstBufferList *buffers;
+  /* PTS of the buffer carrying the meta when it was attached. Should
+   * something restamp that buffer on the way, e.g. unixfdsrc, the audio
+   * moves by the same amount. */
+  GstClockTime pts;
 };
 
 GSTCEF_EXPORT
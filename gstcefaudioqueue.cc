@@ -0,0 +1,205 @@
+#include "gstcefaudioqueue.h"
+
+#define SLOT_MASK (GST_CEF_AUDIO_QUEUE_MAX_SIZE - 1)
+
+G_STATIC_ASSERT ((GST_CEF_AUDIO_QUEUE_MAX_SIZE & SLOT_MASK) == 0);
+
+/* Ring of audio packets between the CEF audio thread, which pushes, and
+ * the streaming thread, which pops. head and tail only ever grow and
+ * wrap around, slots are indexed with their low bits. Only the producer
+ * writes tail and slots. The consumer advances head, but so does the
+ * producer when dropping the oldest packet: both take ownership of a
+ * slot by moving head past it with a compare and exchange. */
+struct _GstCefAudioQueue {
+  gpointer slots[GST_CEF_AUDIO_QUEUE_MAX_SIZE];
+  gint head;
+  gint tail;
+  gint size;
+
+  /* Lets a blocked producer wait for room */
+  GMutex lock;
+  GCond cond;
+  gint waiting;
+  gint flushing;
+
+  gint n_pushed;
+  gint n_dropped;
+  gint max_level;
+};
+
+GstCefAudioQueue *
+gst_cef_audio_queue_new (guint size)
+{
+  GstCefAudioQueue *queue = g_new0 (GstCefAudioQueue, 1);
+
+  g_mutex_init (&queue->lock);
+  g_cond_init (&queue->cond);
+  gst_cef_audio_queue_set_size (queue, size);
+
+  return queue;
+}
+
+void
+gst_cef_audio_queue_free (GstCefAudioQueue *queue)
+{
+  gst_cef_audio_queue_clear (queue);
+  g_mutex_clear (&queue->lock);
+  g_cond_clear (&queue->cond);
+  g_free (queue);
+}
+
+/* Can be changed at any time, packets above a new smaller size stay
+ * queued until popped */
+void
+gst_cef_audio_queue_set_size (GstCefAudioQueue *queue, guint size)
+{
+  g_atomic_int_set (&queue->size, (gint) CLAMP (size, 1, GST_CEF_AUDIO_QUEUE_MAX_SIZE));
+
+  g_mutex_lock (&queue->lock);
+  g_cond_broadcast (&queue->cond);
+  g_mutex_unlock (&queue->lock);
+}
+
+/* While flushing, pushed packets are dropped and a blocked producer
+ * gets released */
+void
+gst_cef_audio_queue_set_flushing (GstCefAudioQueue *queue, gboolean flushing)
+{
+  g_mutex_lock (&queue->lock);
+  g_atomic_int_set (&queue->flushing, flushing);
+  g_cond_broadcast (&queue->cond);
+  g_mutex_unlock (&queue->lock);
+}
+
+guint
+gst_cef_audio_queue_get_level (GstCefAudioQueue *queue)
+{
+  guint head = (guint) g_atomic_int_get (&queue->head);
+  guint tail = (guint) g_atomic_int_get (&queue->tail);
+
+  return tail - head;
+}
+
+static gboolean
+gst_cef_audio_queue_is_full (GstCefAudioQueue *queue)
+{
+  return gst_cef_audio_queue_get_level (queue) >= (guint) g_atomic_int_get (&queue->size);
+}
+
+/* Takes ownership of the slot at the head, NULL when empty */
+static GstBuffer *
+gst_cef_audio_queue_take_head (GstCefAudioQueue *queue)
+{
+  while (TRUE) {
+    gint head = g_atomic_int_get (&queue->head);
+    gpointer buffer;
+
+    if (head == g_atomic_int_get (&queue->tail))
+      return NULL;
+
+    /* Read before claiming, the producer may reuse the slot after */
+    buffer = g_atomic_pointer_get (&queue->slots[(guint) head & SLOT_MASK]);
+    if (g_atomic_int_compare_and_exchange (&queue->head, head, (gint) ((guint) head + 1)))
+      return (GstBuffer *) buffer;
+  }
+}
+
+static void
+gst_cef_audio_queue_drop (GstCefAudioQueue *queue, GstBuffer *buffer)
+{
+  g_atomic_int_inc (&queue->n_dropped);
+  gst_buffer_unref (buffer);
+}
+
+/* Producer side, takes ownership of @buffer */
+void
+gst_cef_audio_queue_push (GstCefAudioQueue *queue, GstBuffer *buffer,
+    GstCefAudioQueueOverflow overflow)
+{
+  guint tail, level;
+
+  if (g_atomic_int_get (&queue->flushing)) {
+    gst_cef_audio_queue_drop (queue, buffer);
+    return;
+  }
+
+  while (gst_cef_audio_queue_is_full (queue)) {
+    GstBuffer *oldest;
+    gboolean flushing;
+
+    switch (overflow) {
+      case GST_CEF_AUDIO_QUEUE_DROP_NEWEST:
+        gst_cef_audio_queue_drop (queue, buffer);
+        return;
+      case GST_CEF_AUDIO_QUEUE_DROP_OLDEST:
+        if ((oldest = gst_cef_audio_queue_take_head (queue)))
+          gst_cef_audio_queue_drop (queue, oldest);
+        break;
+      case GST_CEF_AUDIO_QUEUE_BLOCK:
+        g_mutex_lock (&queue->lock);
+        g_atomic_int_set (&queue->waiting, TRUE);
+        while (!queue->flushing && gst_cef_audio_queue_is_full (queue))
+          g_cond_wait (&queue->cond, &queue->lock);
+        g_atomic_int_set (&queue->waiting, FALSE);
+        flushing = queue->flushing;
+        g_mutex_unlock (&queue->lock);
+
+        if (flushing) {
+          gst_cef_audio_queue_drop (queue, buffer);
+          return;
+        }
+        break;
+    }
+  }
+
+  tail = (guint) g_atomic_int_get (&queue->tail);
+  g_atomic_pointer_set (&queue->slots[tail & SLOT_MASK], buffer);
+  g_atomic_int_set (&queue->tail, (gint) (tail + 1));
+
+  g_atomic_int_inc (&queue->n_pushed);
+  level = gst_cef_audio_queue_get_level (queue);
+  if (level > (guint) g_atomic_int_get (&queue->max_level))
+    g_atomic_int_set (&queue->max_level, (gint) level);
+}
+
+/* Consumer side, NULL when empty */
+GstBuffer *
+gst_cef_audio_queue_pop (GstCefAudioQueue *queue)
+{
+  GstBuffer *buffer = gst_cef_audio_queue_take_head (queue);
+
+  if (buffer && g_atomic_int_get (&queue->waiting)) {
+    g_mutex_lock (&queue->lock);
+    g_cond_broadcast (&queue->cond);
+    g_mutex_unlock (&queue->lock);
+  }
+
+  return buffer;
+}
+
+/* Consumer side */
+void
+gst_cef_audio_queue_clear (GstCefAudioQueue *queue)
+{
+  GstBuffer *buffer;
+
+  while ((buffer = gst_cef_audio_queue_pop (queue)))
+    gst_buffer_unref (buffer);
+}
+
+void
+gst_cef_audio_queue_get_stats (GstCefAudioQueue *queue, guint *pushed,
+    guint *dropped, guint *max_level)
+{
+  *pushed = (guint) g_atomic_int_get (&queue->n_pushed);
+  *dropped = (guint) g_atomic_int_get (&queue->n_dropped);
+  *max_level = (guint) g_atomic_int_get (&queue->max_level);
+}
+
+void
+gst_cef_audio_queue_reset_stats (GstCefAudioQueue *queue)
+{
+  g_atomic_int_set (&queue->n_pushed, 0);
+  g_atomic_int_set (&queue->n_dropped, 0);
+  g_atomic_int_set (&queue->max_level, 0);
+}
@@ -0,0 +1,46 @@
+#ifndef __GST_CEF_AUDIO_QUEUE_H__
+#define __GST_CEF_AUDIO_QUEUE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// most audio packets a queue can be sized for
+#define GST_CEF_AUDIO_QUEUE_MAX_SIZE 1024
+
+typedef enum {
+  // the oldest queued packet makes room for the new one
+  GST_CEF_AUDIO_QUEUE_DROP_OLDEST = 0,
+  // the new packet is dropped
+  GST_CEF_AUDIO_QUEUE_DROP_NEWEST = 1,
+  // the producer waits for the consumer to make room
+  GST_CEF_AUDIO_QUEUE_BLOCK = 2,
+} GstCefAudioQueueOverflow;
+
+typedef struct _GstCefAudioQueue GstCefAudioQueue;
+
+GstCefAudioQueue *gst_cef_audio_queue_new (guint size);
+
+void gst_cef_audio_queue_free (GstCefAudioQueue *queue);
+
+void gst_cef_audio_queue_set_size (GstCefAudioQueue *queue, guint size);
+
+void gst_cef_audio_queue_set_flushing (GstCefAudioQueue *queue, gboolean flushing);
+
+void gst_cef_audio_queue_push (GstCefAudioQueue *queue, GstBuffer *buffer,
+    GstCefAudioQueueOverflow overflow);
+
+GstBuffer *gst_cef_audio_queue_pop (GstCefAudioQueue *queue);
+
+void gst_cef_audio_queue_clear (GstCefAudioQueue *queue);
+
+guint gst_cef_audio_queue_get_level (GstCefAudioQueue *queue);
+
+void gst_cef_audio_queue_get_stats (GstCefAudioQueue *queue, guint *pushed,
+    guint *dropped, guint *max_level);
+
+void gst_cef_audio_queue_reset_stats (GstCefAudioQueue *queue);
+
+G_END_DECLS
+
+#endif /* __GST_CEF_AUDIO_QUEUE_H__ */
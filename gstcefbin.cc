@@ -1,7 +1,22 @@
 #include "gstcefbin.h"
 #include "gstcefaudiometa.h"
 
-#define CEF_VIDEO_CAPS "video/x-raw, format=BGRA, width=[1, 2147483647], height=[1, 2147483647], framerate=[1/1, 60/1], pixel-aspect-ratio=1/1"
+#include <glib/gstdio.h>
+#ifdef G_OS_UNIX
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#define DEFAULT_HELPER_PROCESS FALSE
+#define CEF_BIN_HELPER_LAUNCH "gst-launch-1.0"
+/* Read by cefsrc, keeps the settings off the helper's command line */
+#define CEF_BIN_HELPER_SETTINGS_ENV "GST_CEF_SRC_SETTINGS"
+/* How long the helper gets to start listening on its socket */
+#define CEF_BIN_HELPER_TIMEOUT (10 * G_USEC_PER_SEC)
+/* How long the helper gets to shut down before it is killed */
+#define CEF_BIN_HELPER_STOP_TIMEOUT (5 * G_USEC_PER_SEC)
+
+#define CEF_VIDEO_CAPS "video/x-raw, format={ BGRA, I420, NV12, Y444 }, width=[1, 2147483647], height=[1, 2147483647], framerate=[0/1, 240/1], pixel-aspect-ratio=1/1"
 #define CEF_AUDIO_CAPS "audio/x-raw, format=F32LE, rate=[1, 2147483647], channels=[1, 2147483647], layout=interleaved"
 
 static GstURIType
@@ -69,6 +84,15 @@ gst_cef_bin_uri_handler_init (gpointer g_iface, gpointer iface_data)
 G_DEFINE_TYPE_WITH_CODE (GstCefBin, gst_cef_bin, GST_TYPE_BIN,
     G_IMPLEMENT_INTERFACE (GST_TYPE_URI_HANDLER, gst_cef_bin_uri_handler_init));
 
+#define parent_class gst_cef_bin_parent_class
+
+enum
+{
+  PROP_0,
+  PROP_HELPER_PROCESS,
+  PROP_HELPER_CAPS,
+};
+
 static GstStaticPadTemplate gst_cef_bin_video_src_template =
 GST_STATIC_PAD_TEMPLATE ("video",
     GST_PAD_SRC,
@@ -98,12 +122,383 @@ gst_cef_bin_init (GstCefBin * self)
 
   gst_element_add_pad (GST_ELEMENT (self), self->vsrcpad);
   gst_element_add_pad (GST_ELEMENT (self), self->asrcpad);
+
+  self->helper_process = DEFAULT_HELPER_PROCESS;
+  self->helper_caps = NULL;
+  self->fdsrc = NULL;
+  self->subprocess = NULL;
+  self->watch_thread = NULL;
+  self->watch_context = NULL;
+  self->watch_loop = NULL;
+  self->cancellable = NULL;
+  self->socket_path = NULL;
+  g_mutex_init (&self->helper_lock);
+  g_cond_init (&self->helper_cond);
+  self->helper_ready = FALSE;
+  self->helper_exited = FALSE;
+  self->helper_stopping = FALSE;
 }
 
 static void
 gst_cef_bin_finalize (GObject *object)
 {
-  //GstCefBin *self = GST_CEF_BIN (object);
+  GstCefBin *self = GST_CEF_BIN (object);
+
+  gst_caps_replace (&self->helper_caps, NULL);
+  g_mutex_clear (&self->helper_lock);
+  g_cond_clear (&self->helper_cond);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+#ifdef G_OS_UNIX
+/* cefsrc settings that differ from the defaults, cefsrc being the only
+ * instance in the helper makes the process-wide ones per instance.
+ * They go through the environment, only readable by the same user
+ * unlike the command line. */
+static gchar *
+gst_cef_bin_get_helper_settings (GstCefBin *self)
+{
+  GstStructure *settings = gst_structure_new_empty ("cefsrc");
+  GParamSpec **pspecs;
+  guint i, n_pspecs;
+  gchar *ret;
+
+  pspecs = g_object_class_list_properties (G_OBJECT_GET_CLASS (self->cefsrc), &n_pspecs);
+  for (i = 0; i < n_pspecs; i++) {
+    GParamSpec *pspec = pspecs[i];
+    GValue value = G_VALUE_INIT;
+    gchar *str;
+
+    if ((pspec->flags & G_PARAM_READWRITE) != G_PARAM_READWRITE ||
+        pspec->owner_type == GST_TYPE_OBJECT)
+      continue;
+
+    g_value_init (&value, pspec->value_type);
+    g_object_get_property (G_OBJECT (self->cefsrc), pspec->name, &value);
+    if (!g_param_value_defaults (pspec, &value) && (str = gst_value_serialize (&value))) {
+      gst_structure_set (settings, pspec->name, G_TYPE_STRING, str, NULL);
+      g_free (str);
+    }
+    g_value_unset (&value);
+  }
+  g_free (pspecs);
+
+  ret = gst_structure_to_string (settings);
+  gst_structure_free (settings);
+
+  return ret;
+}
+
+/* The helper exiting is an error unless we stopped it */
+static void
+gst_cef_bin_helper_exited (GSubprocess *subprocess, GAsyncResult *res, GstCefBin *self)
+{
+  GError *err = NULL;
+
+  if (!g_subprocess_wait_finish (subprocess, res, &err)) {
+    GST_WARNING_OBJECT (self, "Failed to wait for the helper process: %s", err->message);
+    g_clear_error (&err);
+  }
+
+  g_mutex_lock (&self->helper_lock);
+  self->helper_exited = TRUE;
+  g_cond_broadcast (&self->helper_cond);
+  g_mutex_unlock (&self->helper_lock);
+
+  if (!g_atomic_int_get (&self->helper_stopping)) {
+    if (g_subprocess_get_if_exited (subprocess)) {
+      GST_ELEMENT_ERROR (self, RESOURCE, FAILED, ("The cefsrc helper process exited unexpectedly"),
+          ("Exit status %d", g_subprocess_get_exit_status (subprocess)));
+    } else {
+      GST_ELEMENT_ERROR (self, RESOURCE, FAILED, ("The cefsrc helper process crashed"),
+          ("Terminated by signal %d", g_subprocess_get_term_sig (subprocess)));
+    }
+  }
+
+  g_main_loop_quit (self->watch_loop);
+}
+
+/* gst-launch-1.0 prints a line once setting its pipeline to PAUSED
+ * returned, by then unixfdsink listens. Keeps reading afterwards so
+ * the pipe never fills up. */
+static void
+gst_cef_bin_read_helper_output (GDataInputStream *output, GAsyncResult *res, GstCefBin *self)
+{
+  gchar *line = g_data_input_stream_read_line_finish (output, res, NULL, NULL);
+
+  /* End of output, or stopping */
+  if (!line)
+    return;
+
+  GST_DEBUG_OBJECT (self, "helper: %s", line);
+  g_free (line);
+
+  g_mutex_lock (&self->helper_lock);
+  if (!self->helper_ready && g_file_test (self->socket_path, G_FILE_TEST_EXISTS)) {
+    self->helper_ready = TRUE;
+    g_cond_broadcast (&self->helper_cond);
+  }
+  g_mutex_unlock (&self->helper_lock);
+
+  g_data_input_stream_read_line_async (output, G_PRIORITY_DEFAULT, self->cancellable,
+      (GAsyncReadyCallback) gst_cef_bin_read_helper_output, self);
+}
+
+/* Runs until the helper exits */
+static gpointer
+gst_cef_bin_watch_helper (GstCefBin *self)
+{
+  GDataInputStream *output;
+
+  g_main_context_push_thread_default (self->watch_context);
+
+  output = g_data_input_stream_new (g_subprocess_get_stdout_pipe (self->subprocess));
+  g_data_input_stream_read_line_async (output, G_PRIORITY_DEFAULT, self->cancellable,
+      (GAsyncReadyCallback) gst_cef_bin_read_helper_output, self);
+  g_subprocess_wait_async (self->subprocess, NULL,
+      (GAsyncReadyCallback) gst_cef_bin_helper_exited, self);
+
+  g_main_loop_run (self->watch_loop);
+
+  /* CEF subprocesses may still hold the pipe open, finish reading */
+  g_cancellable_cancel (self->cancellable);
+  while (g_main_context_pending (self->watch_context))
+    g_main_context_iteration (self->watch_context, FALSE);
+
+  g_object_unref (output);
+  g_main_context_pop_thread_default (self->watch_context);
+
+  return NULL;
+}
+
+static gboolean
+gst_cef_bin_start_helper (GstCefBin *self)
+{
+  static gint helper_id = 0;
+  GSubprocessLauncher *launcher;
+  GPtrArray *argv;
+  GError *err = NULL;
+  gchar *name, *settings;
+
+  self->fdsrc = gst_element_factory_make ("unixfdsrc", "helper-src");
+  if (!self->fdsrc) {
+    GST_ELEMENT_ERROR (self, CORE, MISSING_PLUGIN, ("unixfdsrc is missing"),
+        ("helper-process needs the unixfd plugin from GStreamer 1.24 or newer"));
+    return FALSE;
+  }
+
+  name = g_strdup_printf ("gstcef-%d-%d.sock", (gint) getpid (), g_atomic_int_add (&helper_id, 1));
+  self->socket_path = g_build_filename (g_get_user_runtime_dir (), name, NULL);
+  g_free (name);
+  g_unlink (self->socket_path);
+
+  argv = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_add (argv, g_strdup (CEF_BIN_HELPER_LAUNCH));
+  g_ptr_array_add (argv, g_strdup ("cefsrc"));
+  g_ptr_array_add (argv, g_strdup ("fd-memory=true"));
+  g_ptr_array_add (argv, g_strdup ("helper-settings-env=" CEF_BIN_HELPER_SETTINGS_ENV));
+  if (self->helper_caps) {
+    gchar *caps = gst_caps_to_string (self->helper_caps);
+
+    g_ptr_array_add (argv, g_strdup ("!"));
+    g_ptr_array_add (argv, g_strdup ("capsfilter"));
+    g_ptr_array_add (argv, g_strdup_printf ("caps=\"%s\"", caps));
+    g_free (caps);
+  }
+  g_ptr_array_add (argv, g_strdup ("!"));
+  g_ptr_array_add (argv, g_strdup ("unixfdsink"));
+  g_ptr_array_add (argv, g_strdup_printf ("socket-path=%s", self->socket_path));
+  g_ptr_array_add (argv, NULL);
+
+  launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE);
+  settings = gst_cef_bin_get_helper_settings (self);
+  g_subprocess_launcher_setenv (launcher, CEF_BIN_HELPER_SETTINGS_ENV, settings, TRUE);
+  g_free (settings);
+
+  self->subprocess = g_subprocess_launcher_spawnv (launcher,
+      (const gchar * const *) argv->pdata, &err);
+  g_object_unref (launcher);
+  g_ptr_array_unref (argv);
+
+  if (!self->subprocess) {
+    GST_ELEMENT_ERROR (self, RESOURCE, FAILED, ("Failed to start the cefsrc helper process"),
+        ("%s", err->message));
+    g_clear_error (&err);
+    g_clear_pointer (&self->socket_path, g_free);
+    gst_clear_object (&self->fdsrc);
+    return FALSE;
+  }
+
+  GST_INFO_OBJECT (self, "Started helper process %s on %s",
+      g_subprocess_get_identifier (self->subprocess), self->socket_path);
+
+  self->watch_context = g_main_context_new ();
+  self->watch_loop = g_main_loop_new (self->watch_context, FALSE);
+  self->cancellable = g_cancellable_new ();
+  self->helper_ready = FALSE;
+  self->helper_exited = FALSE;
+  g_atomic_int_set (&self->helper_stopping, FALSE);
+  self->watch_thread = g_thread_new ("cefbin-helper", (GThreadFunc) gst_cef_bin_watch_helper, self);
+
+  /* cefsrc stays out of the bin, but keeps the settings */
+  gst_object_ref (self->cefsrc);
+  gst_bin_remove (GST_BIN (self), self->cefsrc);
+  g_object_set (self->fdsrc, "socket-path", self->socket_path, NULL);
+  gst_bin_add (GST_BIN (self), self->fdsrc);
+  gst_element_link (self->fdsrc, self->cefdemux);
+
+  return TRUE;
+}
+
+/* unixfdsrc connects when starting, by then the helper must listen.
+ * The watch thread wakes us up as soon as it does, or exits. */
+static gboolean
+gst_cef_bin_wait_for_helper (GstCefBin *self)
+{
+  gint64 deadline = g_get_monotonic_time () + CEF_BIN_HELPER_TIMEOUT;
+  gboolean ready;
+
+  g_mutex_lock (&self->helper_lock);
+  while (!self->helper_ready && !self->helper_exited) {
+    if (!g_cond_wait_until (&self->helper_cond, &self->helper_lock, deadline))
+      break;
+  }
+  ready = self->helper_ready;
+  g_mutex_unlock (&self->helper_lock);
+
+  if (!ready) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ, ("The cefsrc helper process did not start"),
+        ("No socket at %s", self->socket_path));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+gst_cef_bin_stop_helper (GstCefBin *self)
+{
+  if (!self->fdsrc)
+    return;
+
+  /* Give the helper a chance to shut CEF down cleanly */
+  if (self->subprocess) {
+    gint64 deadline = g_get_monotonic_time () + CEF_BIN_HELPER_STOP_TIMEOUT;
+    gboolean exited;
+
+    g_atomic_int_set (&self->helper_stopping, TRUE);
+    g_subprocess_send_signal (self->subprocess, SIGINT);
+
+    g_mutex_lock (&self->helper_lock);
+    while (!self->helper_exited) {
+      if (!g_cond_wait_until (&self->helper_cond, &self->helper_lock, deadline))
+        break;
+    }
+    exited = self->helper_exited;
+    g_mutex_unlock (&self->helper_lock);
+
+    if (!exited) {
+      GST_WARNING_OBJECT (self, "Helper process did not exit, killing it");
+      g_subprocess_force_exit (self->subprocess);
+    }
+
+    g_thread_join (self->watch_thread);
+    self->watch_thread = NULL;
+    g_clear_pointer (&self->watch_loop, g_main_loop_unref);
+    g_clear_pointer (&self->watch_context, g_main_context_unref);
+    g_clear_object (&self->cancellable);
+    g_clear_object (&self->subprocess);
+  }
+
+  if (self->socket_path) {
+    g_unlink (self->socket_path);
+    g_clear_pointer (&self->socket_path, g_free);
+  }
+
+  gst_bin_remove (GST_BIN (self), self->fdsrc);
+  self->fdsrc = NULL;
+  gst_bin_add (GST_BIN (self), self->cefsrc);
+  gst_element_link (self->cefsrc, self->cefdemux);
+  gst_object_unref (self->cefsrc);
+}
+#endif
+
+static GstStateChangeReturn
+gst_cef_bin_change_state (GstElement *element, GstStateChange transition)
+{
+  GstCefBin *self = GST_CEF_BIN (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      if (self->helper_process) {
+#ifdef G_OS_UNIX
+        if (!gst_cef_bin_start_helper (self))
+          return GST_STATE_CHANGE_FAILURE;
+#else
+        GST_ELEMENT_ERROR (self, CORE, NOT_IMPLEMENTED, ("helper-process is not supported on this platform"), (NULL));
+        return GST_STATE_CHANGE_FAILURE;
+#endif
+      }
+      break;
+#ifdef G_OS_UNIX
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      if (self->subprocess && !gst_cef_bin_wait_for_helper (self))
+        return GST_STATE_CHANGE_FAILURE;
+      break;
+#endif
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+#ifdef G_OS_UNIX
+  if (transition == GST_STATE_CHANGE_READY_TO_NULL ||
+      (transition == GST_STATE_CHANGE_NULL_TO_READY && ret == GST_STATE_CHANGE_FAILURE))
+    gst_cef_bin_stop_helper (self);
+#endif
+
+  return ret;
+}
+
+static void
+gst_cef_bin_set_property (GObject * object, guint prop_id, const GValue * value,
+    GParamSpec * pspec)
+{
+  GstCefBin *self = GST_CEF_BIN (object);
+
+  switch (prop_id) {
+    case PROP_HELPER_PROCESS:
+      self->helper_process = g_value_get_boolean (value);
+      break;
+    case PROP_HELPER_CAPS:
+      gst_caps_replace (&self->helper_caps, (GstCaps *) gst_value_get_caps (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_cef_bin_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstCefBin *self = GST_CEF_BIN (object);
+
+  switch (prop_id) {
+    case PROP_HELPER_PROCESS:
+      g_value_set_boolean (value, self->helper_process);
+      break;
+    case PROP_HELPER_CAPS:
+      gst_value_set_caps (value, self->helper_caps);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
 }
 
 static void
@@ -128,6 +523,7 @@ gst_cef_bin_constructed (GObject *object)
   gst_bin_add_many(GST_BIN (self), cefsrc, cefdemux, aqueue, vqueue, NULL);
 
   gst_element_link (cefsrc, cefdemux);
+  self->cefdemux = cefdemux;
 
   gst_element_link_pads(cefdemux, "video", vqueue, "sink");
   gst_element_link_pads(cefdemux, "audio", aqueue, "sink");
@@ -163,6 +559,23 @@ gst_cef_bin_class_init (GstCefBinClass * klass)
 
   gobject_class->constructed = gst_cef_bin_constructed;
   gobject_class->finalize = gst_cef_bin_finalize;
+  gobject_class->set_property = gst_cef_bin_set_property;
+  gobject_class->get_property = gst_cef_bin_get_property;
+
+  gstelement_class->change_state = gst_cef_bin_change_state;
+
+  g_object_class_install_property (gobject_class, PROP_HELPER_PROCESS,
+      g_param_spec_boolean ("helper-process", "helper-process",
+          "Run the browser in a helper process with its own CEF settings, "
+          "receiving frames and audio through unixfd",
+          DEFAULT_HELPER_PROCESS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property (gobject_class, PROP_HELPER_CAPS,
+      g_param_spec_boxed ("helper-caps", "helper-caps",
+          "Caps the helper process outputs, downstream caps do not reach it",
+          GST_TYPE_CAPS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
 
   gst_element_class_set_static_metadata (gstelement_class,
       "Chromium Embedded Framework source bin", "Source/Audio/Video",
@@ -2,6 +2,7 @@
 #define __GST_CEF_BIN_H__
 
 #include <gst/gst.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -22,8 +23,30 @@ typedef struct _GstCefBinClass GstCefBinClass;
 struct _GstCefBin {
   GstBin parent;
   GstElement *cefsrc;
+  GstElement *cefdemux;
   GstPad *asrcpad;
   GstPad *vsrcpad;
+  /* With helper-process, cefsrc only holds the settings between NULL
+   * and READY: the browser runs in a gst-launch-1.0 subprocess, whose
+   * frames come in through unixfdsrc */
+  gboolean helper_process;
+  GstCaps *helper_caps;
+  GstElement *fdsrc;
+  GSubprocess *subprocess;
+  /* The watch thread runs its own main context, waiting for the helper
+   * to exit and reading its output */
+  GThread *watch_thread;
+  GMainContext *watch_context;
+  GMainLoop *watch_loop;
+  GCancellable *cancellable;
+  gchar *socket_path;
+  /* Signalled by the watch thread once the helper listens on its socket
+   * and once it exited, which is only an error when not stopping it */
+  GMutex helper_lock;
+  GCond helper_cond;
+  gboolean helper_ready;
+  gboolean helper_exited;
+  gint helper_stopping;
 };
 
 struct _GstCefBinClass {
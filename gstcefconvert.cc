@@ -0,0 +1,435 @@
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GST_CEF_CONVERT_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define GST_CEF_CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "gstcefconvert.h"
+
+#define SCALE_BITS 14
+#define ROUND (1 << (SCALE_BITS - 1))
+
+/* Below this many pixels, a rectangle is not worth waking up workers for */
+#define STRIPE_MIN_PIXELS (256 * 256)
+
+gboolean
+gst_cef_convert_format_is_supported (GstVideoFormat format)
+{
+  switch (format) {
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_NV12:
+    case GST_VIDEO_FORMAT_Y444:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+void
+gst_cef_convert_matrix_init (GstCefConvertMatrix *matrix, const GstVideoInfo *info)
+{
+  gdouble Kr, Kb, Kg, y_scale, uv_scale;
+  const gdouble one = 1 << SCALE_BITS;
+
+  if (!gst_video_color_matrix_get_Kr_Kb (info->colorimetry.matrix, &Kr, &Kb)) {
+    Kr = 0.2126;
+    Kb = 0.0722;
+  }
+  Kg = 1.0 - Kr - Kb;
+
+  if (info->colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255) {
+    y_scale = uv_scale = 1.0;
+    matrix->y_off = 0;
+  } else {
+    y_scale = 219.0 / 255.0;
+    uv_scale = 224.0 / 255.0;
+    matrix->y_off = 16;
+  }
+
+  matrix->yr = (gint) (Kr * y_scale * one + 0.5);
+  matrix->yg = (gint) (Kg * y_scale * one + 0.5);
+  matrix->yb = (gint) (Kb * y_scale * one + 0.5);
+
+  matrix->ur = (gint) (-Kr / (2.0 * (1.0 - Kb)) * uv_scale * one - 0.5);
+  matrix->ug = (gint) (-Kg / (2.0 * (1.0 - Kb)) * uv_scale * one - 0.5);
+  matrix->ub = (gint) (0.5 * uv_scale * one + 0.5);
+
+  matrix->vr = (gint) (0.5 * uv_scale * one + 0.5);
+  matrix->vg = (gint) (-Kg / (2.0 * (1.0 - Kr)) * uv_scale * one - 0.5);
+  matrix->vb = (gint) (-Kb / (2.0 * (1.0 - Kr)) * uv_scale * one - 0.5);
+}
+
+/* Chroma subsampled formats are converted in 2x2 blocks */
+void
+gst_cef_convert_align_rect (const GstVideoInfo *info, GstVideoRectangle *rect)
+{
+  gint x1, y1;
+
+  if (GST_VIDEO_INFO_FORMAT (info) == GST_VIDEO_FORMAT_Y444 ||
+      GST_VIDEO_INFO_FORMAT (info) == GST_VIDEO_FORMAT_BGRA)
+    return;
+
+  x1 = MIN (GST_ROUND_UP_2 (rect->x + rect->w), GST_VIDEO_INFO_WIDTH (info));
+  y1 = MIN (GST_ROUND_UP_2 (rect->y + rect->h), GST_VIDEO_INFO_HEIGHT (info));
+  rect->x = GST_ROUND_DOWN_2 (rect->x);
+  rect->y = GST_ROUND_DOWN_2 (rect->y);
+  rect->w = x1 - rect->x;
+  rect->h = y1 - rect->y;
+}
+
+static inline guint8
+clamp_u8 (gint v)
+{
+  return (guint8) CLAMP (v, 0, 255);
+}
+
+static void
+convert_row_y_scalar (const guint8 *bgra, guint8 *y, gint n, const GstCefConvertMatrix *m)
+{
+  gint i;
+
+  for (i = 0; i < n; i++, bgra += 4)
+    y[i] = clamp_u8 (((m->yr * bgra[2] + m->yg * bgra[1] + m->yb * bgra[0] + ROUND) >> SCALE_BITS) + m->y_off);
+}
+
+static void
+convert_row_uv_scalar (const guint8 *bgra, guint8 *u, guint8 *v, gint step, gint n,
+    const GstCefConvertMatrix *m)
+{
+  gint i;
+
+  for (i = 0; i < n; i++, bgra += 4) {
+    u[i * step] = clamp_u8 (((m->ur * bgra[2] + m->ug * bgra[1] + m->ub * bgra[0] + ROUND) >> SCALE_BITS) + 128);
+    v[i * step] = clamp_u8 (((m->vr * bgra[2] + m->vg * bgra[1] + m->vb * bgra[0] + ROUND) >> SCALE_BITS) + 128);
+  }
+}
+
+/* Averages 2x2 blocks of rows @a and @b into @out, @n_in may be odd */
+static void
+downsample_rows_scalar (const guint8 *a, const guint8 *b, guint8 *out, gint n_in)
+{
+  gint i, c;
+
+  for (i = 0; i + 1 < n_in; i += 2, a += 8, b += 8, out += 4) {
+    for (c = 0; c < 4; c++)
+      out[c] = (a[c] + a[c + 4] + b[c] + b[c + 4] + 2) >> 2;
+  }
+
+  if (i < n_in) {
+    for (c = 0; c < 4; c++)
+      out[c] = (a[c] + b[c] + 1) >> 1;
+  }
+}
+
+#if defined(GST_CEF_CONVERT_SSE2)
+
+/* B * cb + G * cg + R * cr for 4 BGRA pixels */
+static inline __m128i
+sse2_dot4 (__m128i px, __m128i coef)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128i lo = _mm_madd_epi16 (_mm_unpacklo_epi8 (px, zero), coef);
+  __m128i hi = _mm_madd_epi16 (_mm_unpackhi_epi8 (px, zero), coef);
+  __m128 lo_ps = _mm_castsi128_ps (lo), hi_ps = _mm_castsi128_ps (hi);
+  __m128i even = _mm_castps_si128 (_mm_shuffle_ps (lo_ps, hi_ps, _MM_SHUFFLE (2, 0, 2, 0)));
+  __m128i odd = _mm_castps_si128 (_mm_shuffle_ps (lo_ps, hi_ps, _MM_SHUFFLE (3, 1, 3, 1)));
+
+  return _mm_add_epi32 (even, odd);
+}
+
+/* 8 pixels to 8 signed 16 bit values, offset added */
+static inline __m128i
+sse2_convert8 (const guint8 *bgra, __m128i coef, __m128i off)
+{
+  const __m128i round = _mm_set1_epi32 (ROUND);
+  __m128i s0 = sse2_dot4 (_mm_loadu_si128 ((const __m128i *) bgra), coef);
+  __m128i s1 = sse2_dot4 (_mm_loadu_si128 ((const __m128i *) (bgra + 16)), coef);
+
+  s0 = _mm_srai_epi32 (_mm_add_epi32 (s0, round), SCALE_BITS);
+  s1 = _mm_srai_epi32 (_mm_add_epi32 (s1, round), SCALE_BITS);
+
+  return _mm_add_epi16 (_mm_packs_epi32 (s0, s1), off);
+}
+
+static void
+convert_row_y (const guint8 *bgra, guint8 *y, gint n, const GstCefConvertMatrix *m)
+{
+  const __m128i coef = _mm_setr_epi16 (m->yb, m->yg, m->yr, 0, m->yb, m->yg, m->yr, 0);
+  const __m128i off = _mm_set1_epi16 (m->y_off);
+  gint i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m128i v = sse2_convert8 (bgra + i * 4, coef, off);
+
+    _mm_storel_epi64 ((__m128i *) (y + i), _mm_packus_epi16 (v, v));
+  }
+
+  convert_row_y_scalar (bgra + i * 4, y + i, n - i, m);
+}
+
+static void
+convert_row_uv (const guint8 *bgra, guint8 *u, guint8 *v, gint step, gint n,
+    const GstCefConvertMatrix *m)
+{
+  const __m128i ucoef = _mm_setr_epi16 (m->ub, m->ug, m->ur, 0, m->ub, m->ug, m->ur, 0);
+  const __m128i vcoef = _mm_setr_epi16 (m->vb, m->vg, m->vr, 0, m->vb, m->vg, m->vr, 0);
+  const __m128i off = _mm_set1_epi16 (128);
+  const __m128i zero = _mm_setzero_si128 ();
+  gint i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m128i u8 = _mm_packus_epi16 (sse2_convert8 (bgra + i * 4, ucoef, off), zero);
+    __m128i v8 = _mm_packus_epi16 (sse2_convert8 (bgra + i * 4, vcoef, off), zero);
+
+    if (step == 2) {
+      _mm_storeu_si128 ((__m128i *) (u + i * 2), _mm_unpacklo_epi8 (u8, v8));
+    } else {
+      _mm_storel_epi64 ((__m128i *) (u + i), u8);
+      _mm_storel_epi64 ((__m128i *) (v + i), v8);
+    }
+  }
+
+  convert_row_uv_scalar (bgra + i * 4, u + i * step, v + i * step, step, n - i, m);
+}
+
+static void
+downsample_rows (const guint8 *a, const guint8 *b, guint8 *out, gint n_in)
+{
+  gint i;
+
+  for (i = 0; i + 8 <= n_in; i += 8) {
+    __m128 v0 = _mm_castsi128_ps (_mm_avg_epu8 (
+        _mm_loadu_si128 ((const __m128i *) (a + i * 4)),
+        _mm_loadu_si128 ((const __m128i *) (b + i * 4))));
+    __m128 v1 = _mm_castsi128_ps (_mm_avg_epu8 (
+        _mm_loadu_si128 ((const __m128i *) (a + i * 4 + 16)),
+        _mm_loadu_si128 ((const __m128i *) (b + i * 4 + 16))));
+    __m128i even = _mm_castps_si128 (_mm_shuffle_ps (v0, v1, _MM_SHUFFLE (2, 0, 2, 0)));
+    __m128i odd = _mm_castps_si128 (_mm_shuffle_ps (v0, v1, _MM_SHUFFLE (3, 1, 3, 1)));
+
+    _mm_storeu_si128 ((__m128i *) (out + i * 2), _mm_avg_epu8 (even, odd));
+  }
+
+  downsample_rows_scalar (a + i * 4, b + i * 4, out + i * 2, n_in - i);
+}
+
+#elif defined(GST_CEF_CONVERT_NEON)
+
+/* 8 pixels to 8 signed 16 bit values, offset added */
+static inline int16x8_t
+neon_convert8 (const uint8x8x4_t *px, gint cr, gint cg, gint cb, gint off)
+{
+  int16x8_t b = vreinterpretq_s16_u16 (vmovl_u8 (px->val[0]));
+  int16x8_t g = vreinterpretq_s16_u16 (vmovl_u8 (px->val[1]));
+  int16x8_t r = vreinterpretq_s16_u16 (vmovl_u8 (px->val[2]));
+  int32x4_t lo, hi;
+
+  lo = vmull_n_s16 (vget_low_s16 (r), cr);
+  lo = vmlal_n_s16 (lo, vget_low_s16 (g), cg);
+  lo = vmlal_n_s16 (lo, vget_low_s16 (b), cb);
+  hi = vmull_n_s16 (vget_high_s16 (r), cr);
+  hi = vmlal_n_s16 (hi, vget_high_s16 (g), cg);
+  hi = vmlal_n_s16 (hi, vget_high_s16 (b), cb);
+
+  return vaddq_s16 (vcombine_s16 (vrshrn_n_s32 (lo, SCALE_BITS), vrshrn_n_s32 (hi, SCALE_BITS)),
+      vdupq_n_s16 (off));
+}
+
+static void
+convert_row_y (const guint8 *bgra, guint8 *y, gint n, const GstCefConvertMatrix *m)
+{
+  gint i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    uint8x8x4_t px = vld4_u8 (bgra + i * 4);
+
+    vst1_u8 (y + i, vqmovun_s16 (neon_convert8 (&px, m->yr, m->yg, m->yb, m->y_off)));
+  }
+
+  convert_row_y_scalar (bgra + i * 4, y + i, n - i, m);
+}
+
+static void
+convert_row_uv (const guint8 *bgra, guint8 *u, guint8 *v, gint step, gint n,
+    const GstCefConvertMatrix *m)
+{
+  gint i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    uint8x8x4_t px = vld4_u8 (bgra + i * 4);
+    uint8x8x2_t uv;
+
+    uv.val[0] = vqmovun_s16 (neon_convert8 (&px, m->ur, m->ug, m->ub, 128));
+    uv.val[1] = vqmovun_s16 (neon_convert8 (&px, m->vr, m->vg, m->vb, 128));
+
+    if (step == 2) {
+      vst2_u8 (u + i * 2, uv);
+    } else {
+      vst1_u8 (u + i, uv.val[0]);
+      vst1_u8 (v + i, uv.val[1]);
+    }
+  }
+
+  convert_row_uv_scalar (bgra + i * 4, u + i * step, v + i * step, step, n - i, m);
+}
+
+static void
+downsample_rows (const guint8 *a, const guint8 *b, guint8 *out, gint n_in)
+{
+  gint i, c;
+
+  for (i = 0; i + 16 <= n_in; i += 16) {
+    uint8x16x4_t pa = vld4q_u8 (a + i * 4);
+    uint8x16x4_t pb = vld4q_u8 (b + i * 4);
+    uint8x8x4_t res;
+
+    for (c = 0; c < 4; c++)
+      res.val[c] = vrshrn_n_u16 (vpadalq_u8 (vpaddlq_u8 (pa.val[c]), pb.val[c]), 2);
+
+    vst4_u8 (out + i * 2, res);
+  }
+
+  downsample_rows_scalar (a + i * 4, b + i * 4, out + i * 2, n_in - i);
+}
+
+#else
+
+#define convert_row_y convert_row_y_scalar
+#define convert_row_uv convert_row_uv_scalar
+#define downsample_rows downsample_rows_scalar
+
+#endif
+
+typedef struct {
+  const GstCefConvertMatrix *matrix;
+  const guint8 *src;
+  gint src_stride;
+  GstVideoFrame *dst;
+  const GstVideoRectangle *rect;
+} ConvertJob;
+
+static void
+convert_stripe (guint stripe, guint n_stripes, ConvertJob *job)
+{
+  const GstVideoRectangle *rect = job->rect;
+  GstVideoFrame *dst = job->dst;
+  GstVideoFormat format = GST_VIDEO_FRAME_FORMAT (dst);
+  gint n_pairs = (rect->h + 1) / 2;
+  gint y0 = rect->y + 2 * (gint) (n_pairs * stripe / n_stripes);
+  gint y1 = MIN (rect->y + 2 * (gint) (n_pairs * (stripe + 1) / n_stripes), rect->y + rect->h);
+  gint w = rect->w, cw = (rect->w + 1) / 2;
+  guint8 *tmp = NULL;
+  gint y;
+
+  if (format != GST_VIDEO_FORMAT_Y444)
+    tmp = (guint8 *) g_malloc (cw * 4);
+
+  for (y = y0; y < y1; y++) {
+    const guint8 *row = job->src + (gsize) y * job->src_stride + rect->x * 4;
+    guint8 *dy = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (dst, 0) +
+        (gsize) y * GST_VIDEO_FRAME_PLANE_STRIDE (dst, 0) + rect->x;
+
+    convert_row_y (row, dy, w, job->matrix);
+
+    if (format == GST_VIDEO_FORMAT_Y444) {
+      guint8 *du = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (dst, 1) +
+          (gsize) y * GST_VIDEO_FRAME_PLANE_STRIDE (dst, 1) + rect->x;
+      guint8 *dv = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (dst, 2) +
+          (gsize) y * GST_VIDEO_FRAME_PLANE_STRIDE (dst, 2) + rect->x;
+
+      convert_row_uv (row, du, dv, 1, w, job->matrix);
+    } else if ((y - rect->y) % 2 == 0) {
+      const guint8 *next = y + 1 < rect->y + rect->h ? row + job->src_stride : row;
+      gint cy = y / 2, cx = rect->x / 2;
+
+      downsample_rows (row, next, tmp, w);
+
+      if (format == GST_VIDEO_FORMAT_NV12) {
+        guint8 *duv = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (dst, 1) +
+            (gsize) cy * GST_VIDEO_FRAME_PLANE_STRIDE (dst, 1) + cx * 2;
+
+        convert_row_uv (tmp, duv, duv + 1, 2, cw, job->matrix);
+      } else {
+        guint8 *du = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (dst, 1) +
+            (gsize) cy * GST_VIDEO_FRAME_PLANE_STRIDE (dst, 1) + cx;
+        guint8 *dv = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (dst, 2) +
+            (gsize) cy * GST_VIDEO_FRAME_PLANE_STRIDE (dst, 2) + cx;
+
+        convert_row_uv (tmp, du, dv, 1, cw, job->matrix);
+      }
+    }
+  }
+
+  g_free (tmp);
+}
+
+/* Converts @rect of the BGRA image at @src into @dst, which must be
+ * mapped for writing. @rect must have gone through
+ * gst_cef_convert_align_rect(). Large rectangles are split into stripes
+ * of row pairs over @pool when given. */
+void
+gst_cef_convert_rect (const GstCefConvertMatrix *matrix, const guint8 *src,
+    gint src_stride, GstVideoFrame *dst, const GstVideoRectangle *rect,
+    GstCefStripePool *pool)
+{
+  ConvertJob job = { matrix, src, src_stride, dst, rect };
+  guint n_stripes = 1;
+
+  if (rect->w <= 0 || rect->h <= 0)
+    return;
+
+  if (pool && rect->w * rect->h >= STRIPE_MIN_PIXELS) {
+    n_stripes = MIN (gst_cef_stripe_pool_get_n_threads (pool),
+        (guint) (rect->w * rect->h / (STRIPE_MIN_PIXELS / 4)));
+    n_stripes = MIN (n_stripes, (guint) (rect->h + 1) / 2);
+  }
+
+  if (n_stripes > 1)
+    gst_cef_stripe_pool_run (pool, n_stripes, (GstCefStripeFunc) convert_stripe, &job);
+  else
+    convert_stripe (0, 1, &job);
+}
+
+static void
+fill_plane (GstVideoFrame *frame, guint plane, gint width, gint height, guint8 value)
+{
+  guint8 *data = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (frame, plane);
+  gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, plane);
+  gint y;
+
+  for (y = 0; y < height; y++)
+    memset (data + (gsize) y * stride, value, width);
+}
+
+/* Fills @frame with the color of an empty page before anything painted,
+ * transparent for BGRA */
+void
+gst_cef_convert_fill_black (const GstCefConvertMatrix *matrix, GstVideoFrame *frame)
+{
+  gint w = GST_VIDEO_FRAME_WIDTH (frame), h = GST_VIDEO_FRAME_HEIGHT (frame);
+  gint cw = (w + 1) / 2, ch = (h + 1) / 2;
+
+  switch (GST_VIDEO_FRAME_FORMAT (frame)) {
+    case GST_VIDEO_FORMAT_I420:
+      fill_plane (frame, 0, w, h, matrix->y_off);
+      fill_plane (frame, 1, cw, ch, 128);
+      fill_plane (frame, 2, cw, ch, 128);
+      break;
+    case GST_VIDEO_FORMAT_NV12:
+      fill_plane (frame, 0, w, h, matrix->y_off);
+      fill_plane (frame, 1, cw * 2, ch, 128);
+      break;
+    case GST_VIDEO_FORMAT_Y444:
+      fill_plane (frame, 0, w, h, matrix->y_off);
+      fill_plane (frame, 1, w, h, 128);
+      fill_plane (frame, 2, w, h, 128);
+      break;
+    default:
+      fill_plane (frame, 0, w * 4, h, 0);
+      break;
+  }
+}
@@ -0,0 +1,32 @@
+#ifndef __GST_CEF_CONVERT_H__
+#define __GST_CEF_CONVERT_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "gstcefstripepool.h"
+
+G_BEGIN_DECLS
+
+/* Fixed point BGRA to YUV coefficients, scaled by 1 << 14 */
+typedef struct {
+  gint yr, yg, yb, y_off;
+  gint ur, ug, ub;
+  gint vr, vg, vb;
+} GstCefConvertMatrix;
+
+gboolean gst_cef_convert_format_is_supported (GstVideoFormat format);
+
+void gst_cef_convert_matrix_init (GstCefConvertMatrix *matrix, const GstVideoInfo *info);
+
+void gst_cef_convert_align_rect (const GstVideoInfo *info, GstVideoRectangle *rect);
+
+void gst_cef_convert_rect (const GstCefConvertMatrix *matrix, const guint8 *src,
+    gint src_stride, GstVideoFrame *dst, const GstVideoRectangle *rect,
+    GstCefStripePool *pool);
+
+void gst_cef_convert_fill_black (const GstCefConvertMatrix *matrix, GstVideoFrame *frame);
+
+G_END_DECLS
+
+#endif /* __GST_CEF_CONVERT_H__ */
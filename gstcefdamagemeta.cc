@@ -0,0 +1,108 @@
+#include <string.h>
+
+#include "gstcefdamagemeta.h"
+
+static gboolean
+gst_cef_damage_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
+{
+  GstCefDamageMeta *dmeta = (GstCefDamageMeta *) meta;
+
+  dmeta->n_rects = 0;
+
+  return TRUE;
+}
+
+static gboolean
+gst_cef_damage_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstCefDamageMeta *smeta = (GstCefDamageMeta *) meta;
+  GstCefDamageMeta *dmeta;
+  guint i;
+
+  if (GST_META_TRANSFORM_IS_COPY (type)) {
+    dmeta = gst_buffer_add_cef_damage_meta (dest, smeta->rects, smeta->n_rects);
+    if (!dmeta)
+      return FALSE;
+  } else if (GST_VIDEO_META_TRANSFORM_IS_SCALE (type)) {
+    GstVideoMetaTransform *trans = (GstVideoMetaTransform *) data;
+    gint iw = GST_VIDEO_INFO_WIDTH (trans->in_info);
+    gint ih = GST_VIDEO_INFO_HEIGHT (trans->in_info);
+    gint ow = GST_VIDEO_INFO_WIDTH (trans->out_info);
+    gint oh = GST_VIDEO_INFO_HEIGHT (trans->out_info);
+
+    if (iw <= 0 || ih <= 0)
+      return FALSE;
+
+    dmeta = gst_buffer_add_cef_damage_meta (dest, NULL, 0);
+    if (!dmeta)
+      return FALSE;
+
+    /* Round outwards so scaled damage still covers every changed pixel */
+    for (i = 0; i < smeta->n_rects; i++) {
+      const GstVideoRectangle *r = &smeta->rects[i];
+      gint x0 = (gint) gst_util_uint64_scale_int (r->x, ow, iw);
+      gint y0 = (gint) gst_util_uint64_scale_int (r->y, oh, ih);
+      gint x1 = (gint) gst_util_uint64_scale_int_ceil (r->x + r->w, ow, iw);
+      gint y1 = (gint) gst_util_uint64_scale_int_ceil (r->y + r->h, oh, ih);
+
+      dmeta->rects[i].x = x0;
+      dmeta->rects[i].y = y0;
+      dmeta->rects[i].w = MIN (x1, ow) - x0;
+      dmeta->rects[i].h = MIN (y1, oh) - y0;
+    }
+    dmeta->n_rects = smeta->n_rects;
+  } else {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+GstCefDamageMeta *
+gst_buffer_add_cef_damage_meta (GstBuffer * buffer, const GstVideoRectangle *rects, guint n_rects)
+{
+  GstCefDamageMeta *dmeta;
+
+  g_return_val_if_fail (n_rects <= GST_CEF_DAMAGE_META_MAX_RECTS, NULL);
+
+  dmeta =
+      (GstCefDamageMeta *) gst_buffer_add_meta (buffer, GST_CEF_DAMAGE_META_INFO, NULL);
+
+  if (n_rects)
+    memcpy (dmeta->rects, rects, n_rects * sizeof (GstVideoRectangle));
+  dmeta->n_rects = n_rects;
+
+  return dmeta;
+}
+
+GType
+gst_cef_damage_meta_api_get_type (void)
+{
+  static GType type;
+  static const gchar *tags[] = { GST_META_TAG_VIDEO_STR,
+    GST_META_TAG_VIDEO_SIZE_STR, NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstCefDamageMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+const GstMetaInfo *
+gst_cef_damage_meta_get_info (void)
+{
+  static const GstMetaInfo *gst_cef_damage_meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) &gst_cef_damage_meta_info)) {
+    const GstMetaInfo *meta =
+        gst_meta_register (GST_CEF_DAMAGE_META_API_TYPE,
+        "GstCefDamageMeta", sizeof (GstCefDamageMeta),
+        gst_cef_damage_meta_init, NULL,
+        gst_cef_damage_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) &gst_cef_damage_meta_info,
+        (GstMetaInfo *) meta);
+  }
+  return gst_cef_damage_meta_info;
+}
@@ -0,0 +1,53 @@
+#ifndef __GST_CEF_DAMAGE_META_H__
+#define __GST_CEF_DAMAGE_META_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+#define GST_CEF_DAMAGE_META_API_TYPE (gst_cef_damage_meta_api_get_type())
+#define GST_CEF_DAMAGE_META_INFO  (gst_cef_damage_meta_get_info())
+
+#define GST_CEF_DAMAGE_META_MAX_RECTS 8
+
+#ifndef GSTCEF_EXPORT
+#ifdef G_OS_WIN32
+  #define GSTCEF_EXPORT __declspec(dllexport)
+#else
+  #define GSTCEF_EXPORT extern
+#endif
+#endif
+
+typedef struct _GstCefDamageMeta GstCefDamageMeta;
+
+/**
+ * GstCefDamageMeta:
+ * @meta: parent #GstMeta
+ * @n_rects: number of valid entries in @rects, 0 when the frame did not
+ *     change since the previous buffer
+ * @rects: regions of the frame that changed since the previous buffer
+ *
+ * Damage of a cefsrc frame relative to the buffer output before it. The
+ * regions may cover more than what actually changed, never less.
+ */
+struct _GstCefDamageMeta {
+  GstMeta      meta;
+  guint        n_rects;
+  GstVideoRectangle rects[GST_CEF_DAMAGE_META_MAX_RECTS];
+};
+
+GSTCEF_EXPORT
+GType gst_cef_damage_meta_api_get_type (void);
+
+GSTCEF_EXPORT
+const GstMetaInfo * gst_cef_damage_meta_get_info (void);
+
+#define gst_buffer_get_cef_damage_meta(b) ((GstCefDamageMeta*)gst_buffer_get_meta((b), GST_CEF_DAMAGE_META_API_TYPE))
+
+GSTCEF_EXPORT
+GstCefDamageMeta * gst_buffer_add_cef_damage_meta (GstBuffer *buffer, const GstVideoRectangle *rects, guint n_rects);
+
+G_END_DECLS
+
+#endif /* __GST_CEF_DAMAGE_META_H__ */
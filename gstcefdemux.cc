@@ -1,11 +1,25 @@
+#include <stdio.h>
+#include <string.h>
+
 #include <gst/audio/audio.h>
 
 #include "gstcefdemux.h"
 #include "gstcefaudiometa.h"
+#include "gstcefdamagemeta.h"
+#include "gstcefscale.h"
 
-#define CEF_VIDEO_CAPS "video/x-raw, format=BGRA, width=[1, 2147483647], height=[1, 2147483647], framerate=[1/1, 60/1], pixel-aspect-ratio=1/1"
+#define CEF_VIDEO_CAPS "video/x-raw, format={ BGRA, I420, NV12, Y444 }, width=[1, 2147483647], height=[1, 2147483647], framerate=[0/1, 240/1], pixel-aspect-ratio=1/1"
 #define CEF_AUDIO_CAPS "audio/x-raw, format=F32LE, rate=[1, 2147483647], channels=[1, 2147483647], layout=interleaved"
 
+#define DEFAULT_AUDIO_RATE 48000
+#define DEFAULT_AUDIO_CHANNELS 2
+
+#define DEFAULT_FIXED_AUDIO_CAPS FALSE
+
+#define CEF_DEMUX_AUDIO_CHECK_INTERVAL 30
+/* How many elements downstream of the audio pad to look for a consumer */
+#define CEF_DEMUX_MAX_LINK_DEPTH 16
+
 #define GST_CAT_DEFAULT gst_cef_demux_debug
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 
@@ -14,6 +28,12 @@ G_DEFINE_TYPE_WITH_CODE (GstCefDemux, gst_cef_demux, GST_TYPE_ELEMENT,
                          GST_DEBUG_CATEGORY_INIT (gst_cef_demux_debug, "cefdemux", 0,
                                                   "cefdemux element"););
 
+enum
+{
+  PROP_0,
+  PROP_FIXED_AUDIO_CAPS,
+};
+
 static GstStaticPadTemplate gst_cef_demux_sink_template =
 GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
@@ -35,12 +55,238 @@ GST_STATIC_PAD_TEMPLATE ("audio",
     GST_STATIC_CAPS (CEF_AUDIO_CAPS)
 );
 
+static GstStaticPadTemplate gst_cef_demux_scaled_src_template =
+GST_STATIC_PAD_TEMPLATE ("video_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (CEF_VIDEO_CAPS)
+);
+
+/* Source pad outputting the video scaled to whatever size downstream
+ * asks for, all its state is only touched from the streaming thread */
+typedef struct {
+  GstPad parent;
+
+  GstVideoInfo info;
+  /* Last output, updated in place where the input was damaged */
+  GstBuffer *last;
+  /* Outputs come from here when last is still used downstream */
+  GstBufferPool *pool;
+  gboolean need_stream_start;
+  gboolean need_caps;
+  gboolean need_segment;
+} GstCefDemuxScaledPad;
+
+typedef struct {
+  GstPadClass parent_class;
+} GstCefDemuxScaledPadClass;
+
+G_DEFINE_TYPE (GstCefDemuxScaledPad, gst_cef_demux_scaled_pad, GST_TYPE_PAD);
+
+static void
+gst_cef_demux_scaled_pad_clear_pool (GstCefDemuxScaledPad *spad)
+{
+  if (spad->pool) {
+    gst_buffer_pool_set_active (spad->pool, FALSE);
+    gst_clear_object (&spad->pool);
+  }
+}
+
+static void
+gst_cef_demux_scaled_pad_reset (GstCefDemuxScaledPad *spad)
+{
+  gst_buffer_replace (&spad->last, NULL);
+  gst_cef_demux_scaled_pad_clear_pool (spad);
+  gst_video_info_init (&spad->info);
+  spad->need_stream_start = TRUE;
+  spad->need_caps = TRUE;
+  spad->need_segment = TRUE;
+}
+
+static void
+gst_cef_demux_scaled_pad_finalize (GObject *object)
+{
+  GstCefDemuxScaledPad *spad = (GstCefDemuxScaledPad *) object;
+
+  gst_buffer_replace (&spad->last, NULL);
+  gst_cef_demux_scaled_pad_clear_pool (spad);
+
+  G_OBJECT_CLASS (gst_cef_demux_scaled_pad_parent_class)->finalize (object);
+}
+
+static void
+gst_cef_demux_scaled_pad_init (GstCefDemuxScaledPad *spad)
+{
+  spad->last = NULL;
+  spad->pool = NULL;
+  gst_cef_demux_scaled_pad_reset (spad);
+}
+
+static void
+gst_cef_demux_scaled_pad_class_init (GstCefDemuxScaledPadClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = gst_cef_demux_scaled_pad_finalize;
+}
+
+/* Request pads come and go from other threads, the flow of a pad that
+ * was released in the meantime is ignored */
+static GstFlowReturn
+gst_cef_demux_combine_flow (GstCefDemux *demux, GstPad *pad, GstFlowReturn ret)
+{
+  GST_OBJECT_LOCK (demux);
+  if (pad == demux->vsrcpad || pad == demux->asrcpad || g_list_find (demux->scaled_pads, pad))
+    ret = gst_flow_combiner_update_pad_flow (demux->flow_combiner, pad, ret);
+  else
+    ret = gst_flow_combiner_update_flow (demux->flow_combiner, GST_FLOW_OK);
+  GST_OBJECT_UNLOCK (demux);
+
+  return ret;
+}
+
+static GList *
+gst_cef_demux_get_scaled_pads (GstCefDemux *demux)
+{
+  GList *pads;
+
+  GST_OBJECT_LOCK (demux);
+  pads = g_list_copy_deep (demux->scaled_pads, (GCopyFunc) gst_object_ref, NULL);
+  GST_OBJECT_UNLOCK (demux);
+
+  return pads;
+}
+
+static GstCaps *
+gst_cef_demux_new_audio_caps (gint rate, gint channels)
+{
+  return gst_caps_new_simple ("audio/x-raw",
+      "format", G_TYPE_STRING, "F32LE",
+      "rate", G_TYPE_INT, rate,
+      "channels", G_TYPE_INT, channels,
+      "channel-mask", GST_TYPE_BITMASK, gst_audio_channel_get_fallback_mask (channels),
+      "layout", G_TYPE_STRING, "interleaved",
+      NULL);
+}
+
+/* Whether data pushed on @srcpad ends up anywhere: follows internal
+ * links downstream, through queues and bins, until something without
+ * any, a sink. An unlinked ghost pad of cefbin in front of our audio
+ * pad does not count, while a caps query would be answered by its
+ * audio queue. */
+static gboolean
+gst_cef_demux_pad_is_consumed (GstPad *srcpad, guint depth)
+{
+  GstPad *peer = gst_pad_get_peer (srcpad);
+  GValue item = G_VALUE_INIT;
+  GstIterator *it;
+  gboolean ret = FALSE, linked = FALSE, done = FALSE;
+
+  if (!peer)
+    return FALSE;
+
+  /* Give up on looking further and assume there is a consumer */
+  if (depth >= CEF_DEMUX_MAX_LINK_DEPTH) {
+    gst_object_unref (peer);
+    return TRUE;
+  }
+
+  it = gst_pad_iterate_internal_links (peer);
+  while (it && !done) {
+    switch (gst_iterator_next (it, &item)) {
+      case GST_ITERATOR_OK:
+        linked = TRUE;
+        ret = gst_cef_demux_pad_is_consumed ((GstPad *) g_value_get_object (&item), depth + 1);
+        done = ret;
+        g_value_reset (&item);
+        break;
+      case GST_ITERATOR_RESYNC:
+        linked = FALSE;
+        gst_iterator_resync (it);
+        break;
+      default:
+        done = TRUE;
+        break;
+    }
+  }
+  g_value_unset (&item);
+  if (it)
+    gst_iterator_free (it);
+  gst_object_unref (peer);
+
+  return ret || !linked;
+}
+
+static gboolean
+gst_cef_demux_has_audio_consumer (GstCefDemux *demux)
+{
+  return gst_cef_demux_pad_is_consumed (demux->asrcpad, 0);
+}
+
+/* Picks the rate and channels downstream prefers, whatever the sample
+ * format, and asks cefsrc to have CEF produce those. Without a
+ * consumer, asks it not to capture audio at all. Once fixed, the output
+ * format is what we keep asking for. */
+static void
+gst_cef_demux_negotiate_audio (GstCefDemux *demux)
+{
+  GstCaps *caps;
+  GstPad *sinkpad;
+  GstEvent *event;
+
+  demux->audio_rate = DEFAULT_AUDIO_RATE;
+  demux->audio_channels = DEFAULT_AUDIO_CHANNELS;
+  demux->audio_consumed = gst_cef_demux_has_audio_consumer (demux);
+
+  if (demux->fixed_audio_caps && GST_AUDIO_INFO_IS_VALID (&demux->audio_info)) {
+    demux->audio_rate = GST_AUDIO_INFO_RATE (&demux->audio_info);
+    demux->audio_channels = GST_AUDIO_INFO_CHANNELS (&demux->audio_info);
+    caps = gst_caps_new_any ();
+  } else if (demux->audio_consumed) {
+    caps = gst_pad_peer_query_caps (demux->asrcpad, NULL);
+  } else {
+    caps = gst_caps_new_any ();
+  }
+
+  if (!gst_caps_is_empty (caps) && !gst_caps_is_any (caps)) {
+    GstStructure *s;
+
+    caps = gst_caps_truncate (caps);
+    caps = gst_caps_make_writable (caps);
+    s = gst_caps_get_structure (caps, 0);
+    gst_structure_fixate_field_nearest_int (s, "rate", DEFAULT_AUDIO_RATE);
+    gst_structure_fixate_field_nearest_int (s, "channels", DEFAULT_AUDIO_CHANNELS);
+    gst_structure_get_int (s, "rate", &demux->audio_rate);
+    gst_structure_get_int (s, "channels", &demux->audio_channels);
+  }
+  gst_caps_unref (caps);
+
+  GST_DEBUG_OBJECT (demux, "Asking for %d channels at %d Hz, audio %s",
+      demux->audio_channels, demux->audio_rate,
+      demux->audio_consumed ? "consumed" : "unused");
+
+  event = gst_event_new_custom (GST_EVENT_CUSTOM_UPSTREAM,
+      gst_structure_new ("cef-audio-params",
+          "rate", G_TYPE_INT, demux->audio_rate,
+          "channels", G_TYPE_INT, demux->audio_channels,
+          "enabled", G_TYPE_BOOLEAN, demux->audio_consumed,
+          NULL));
+  sinkpad = gst_element_get_static_pad (GST_ELEMENT (demux), "sink");
+  gst_pad_push_event (sinkpad, event);
+  gst_object_unref (sinkpad);
+}
+
 static gboolean
 gst_cef_demux_push_events (GstCefDemux *demux)
 {
   GstSegment segment;
   GstEvent *event;
 
+  /* Linking the audio pad (or a ghost pad in front of it) flags it too,
+   * unlinking is only noticed by checking for a consumer every so often */
+  if (gst_pad_check_reconfigure (demux->asrcpad) ||
+      (++demux->n_audio_checks % CEF_DEMUX_AUDIO_CHECK_INTERVAL == 0 &&
+       gst_cef_demux_has_audio_consumer (demux) != demux->audio_consumed))
+    gst_cef_demux_negotiate_audio (demux);
+
   if (demux->need_stream_start) {
     event = gst_event_new_stream_start ("cefvideo");
     gst_pad_push_event (demux->vsrcpad, event);
@@ -56,17 +302,14 @@ gst_cef_demux_push_events (GstCefDemux *demux)
     gst_pad_push_event (demux->vsrcpad, demux->vcaps_event);
     demux->vcaps_event = NULL;
 
-    /* Push some dummy caps so that our initial gap events don't
-     * get refused */
-    audio_caps = gst_caps_new_simple ("audio/x-raw",
-        "format", G_TYPE_STRING, "F32LE",
-        "rate", G_TYPE_INT, 44100,
-        "channels", G_TYPE_INT, 2,
-        "layout", G_TYPE_STRING, "interleaved",
-        NULL);
-    gst_audio_info_from_caps (&demux->audio_info, audio_caps);
-    gst_pad_push_event (demux->asrcpad, gst_event_new_caps (audio_caps));
-    gst_caps_unref (audio_caps);
+    /* Push the caps we asked CEF for before any audio stream started,
+     * so that our initial gap events don't get refused */
+    if (!GST_AUDIO_INFO_IS_VALID (&demux->audio_info)) {
+      audio_caps = gst_cef_demux_new_audio_caps (demux->audio_rate, demux->audio_channels);
+      gst_audio_info_from_caps (&demux->audio_info, audio_caps);
+      gst_pad_push_event (demux->asrcpad, gst_event_new_caps (audio_caps));
+      gst_caps_unref (audio_caps);
+    }
 
     demux->need_caps = FALSE;
   }
@@ -86,8 +329,8 @@ gst_cef_demux_push_events (GstCefDemux *demux)
 typedef struct
 {
   GstCefDemux *demux;
-  GstFlowCombiner *flow_combiner;
-  GstFlowReturn combined;
+  /* Fallback timestamp, looked up once per list */
+  GstClockTime running_time;
 } AudioPushData;
 
 #if !GST_CHECK_VERSION(1, 18, 0)
@@ -142,12 +385,119 @@ gst_element_get_current_running_time (GstElement * element)
 #endif
 
 
+/* Converts the samples of @buffer from what CEF streams to the fixed
+ * output format, takes ownership of @buffer */
+static void
+gst_cef_demux_clear_audio_converter (GstCefDemux *demux)
+{
+  g_clear_pointer (&demux->audio_converter, gst_audio_converter_free);
+  if (demux->audio_pool) {
+    gst_buffer_pool_set_active (demux->audio_pool, FALSE);
+    gst_clear_object (&demux->audio_pool);
+  }
+  demux->audio_pool_size = 0;
+}
+
+/* CEF hands out packets of the same size, so a pool sized after the
+ * largest one seen so far avoids an allocation per packet */
+static GstBuffer *
+gst_cef_demux_acquire_audio (GstCefDemux *demux, gsize size)
+{
+  GstBuffer *outbuf = NULL;
+
+  if (!demux->audio_pool || size > demux->audio_pool_size) {
+    GstStructure *config;
+
+    if (demux->audio_pool) {
+      gst_buffer_pool_set_active (demux->audio_pool, FALSE);
+      gst_clear_object (&demux->audio_pool);
+    }
+
+    demux->audio_pool = gst_buffer_pool_new ();
+    demux->audio_pool_size = size;
+    config = gst_buffer_pool_get_config (demux->audio_pool);
+    gst_buffer_pool_config_set_params (config, NULL, size, 0, 0);
+    if (!gst_buffer_pool_set_config (demux->audio_pool, config) ||
+        !gst_buffer_pool_set_active (demux->audio_pool, TRUE)) {
+      GST_WARNING_OBJECT (demux, "Failed to set up the audio buffer pool");
+      gst_clear_object (&demux->audio_pool);
+      demux->audio_pool_size = 0;
+    }
+  }
+
+  if (demux->audio_pool &&
+      gst_buffer_pool_acquire_buffer (demux->audio_pool, &outbuf, NULL) == GST_FLOW_OK) {
+    gst_buffer_resize (outbuf, 0, size);
+    return outbuf;
+  }
+
+  return gst_buffer_new_allocate (NULL, size, NULL);
+}
+
+static GstBuffer *
+gst_cef_demux_convert_audio (GstCefDemux *demux, GstBuffer *buffer)
+{
+  GstMapInfo in_map, out_map;
+  gsize in_frames, out_frames;
+  gpointer in[1], out[1];
+  GstBuffer *outbuf;
+
+  /* cefsrc resynced, the resampler history is of no use */
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DISCONT))
+    gst_audio_converter_reset (demux->audio_converter);
+
+  in_frames = gst_buffer_get_size (buffer) / GST_AUDIO_INFO_BPF (&demux->cef_audio_info);
+  out_frames = gst_audio_converter_get_out_frames (demux->audio_converter, in_frames);
+
+  outbuf = gst_cef_demux_acquire_audio (demux, out_frames * GST_AUDIO_INFO_BPF (&demux->audio_info));
+  gst_buffer_copy_into (outbuf, buffer,
+      (GstBufferCopyFlags) (GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS), 0, -1);
+  GST_BUFFER_DURATION (outbuf) = gst_util_uint64_scale (out_frames, GST_SECOND,
+      GST_AUDIO_INFO_RATE (&demux->audio_info));
+
+  gst_buffer_map (buffer, &in_map, GST_MAP_READ);
+  gst_buffer_map (outbuf, &out_map, GST_MAP_WRITE);
+  in[0] = in_map.data;
+  out[0] = out_map.data;
+  if (!gst_audio_converter_samples (demux->audio_converter, GST_AUDIO_CONVERTER_FLAG_NONE,
+          in, in_frames, out, out_frames)) {
+    GST_WARNING_OBJECT (demux, "Failed to convert audio, outputting silence");
+    memset (out_map.data, 0, out_map.size);
+  }
+  gst_buffer_unmap (outbuf, &out_map);
+  gst_buffer_unmap (buffer, &in_map);
+
+  gst_buffer_unref (buffer);
+
+  return outbuf;
+}
+
+/* cefsrc timestamps audio with running time mapped from the CEF
+ * timestamps, fall back to the time the list gets pushed otherwise */
 static gboolean
-gst_cef_demux_push_audio_buffer (GstBuffer **buffer, guint idx, AudioPushData *push_data)
+gst_cef_demux_prepare_audio_buffer (GstBuffer **buffer, guint idx, AudioPushData *push_data)
 {
-  push_data->demux->last_audio_time = gst_element_get_current_running_time (GST_ELEMENT_CAST (push_data->demux));
-  GST_BUFFER_DTS (*buffer) = push_data->demux->last_audio_time;
-  GST_BUFFER_PTS (*buffer) = push_data->demux->last_audio_time;
+  GstClockTime pts;
+
+  if (push_data->demux->audio_converter)
+    *buffer = gst_cef_demux_convert_audio (push_data->demux, *buffer);
+  else
+    *buffer = gst_buffer_make_writable (*buffer);
+  pts = GST_BUFFER_PTS (*buffer);
+
+  if (!GST_CLOCK_TIME_IS_VALID (pts)) {
+    if (!GST_CLOCK_TIME_IS_VALID (push_data->running_time))
+      push_data->running_time =
+          gst_element_get_current_running_time (GST_ELEMENT_CAST (push_data->demux));
+    pts = push_data->running_time;
+  }
+
+  GST_BUFFER_DTS (*buffer) = pts;
+  GST_BUFFER_PTS (*buffer) = pts;
+
+  push_data->demux->last_audio_time = pts;
+  if (GST_CLOCK_TIME_IS_VALID (pts) && GST_BUFFER_DURATION_IS_VALID (*buffer))
+    push_data->demux->last_audio_time += GST_BUFFER_DURATION (*buffer);
 
   gst_buffer_add_audio_meta (*buffer, &push_data->demux->audio_info, 
                              gst_buffer_get_size (*buffer) / GST_AUDIO_INFO_BPF (&push_data->demux->audio_info), 
@@ -159,42 +509,435 @@ gst_cef_demux_push_audio_buffer (GstBuffer **buffer, guint idx, AudioPushData *p
     push_data->demux->need_discont = FALSE;
   }
 
-  push_data->combined = gst_flow_combiner_update_pad_flow (push_data->flow_combiner, push_data->demux->asrcpad,
-      gst_pad_push (push_data->demux->asrcpad, *buffer));
+  return TRUE;
+}
+
+/* Pushes the audio of a frame in one go, takes ownership of @audio */
+static GstFlowReturn
+gst_cef_demux_push_audio (GstCefDemux *demux, GstBufferList *audio)
+{
+  AudioPushData push_data;
+
+  if (gst_buffer_list_length (audio) == 0) {
+    gst_buffer_list_unref (audio);
+    return GST_FLOW_OK;
+  }
+
+  push_data.demux = demux;
+  push_data.running_time = GST_CLOCK_TIME_NONE;
+
+  audio = gst_buffer_list_make_writable (audio);
+  gst_buffer_list_foreach (audio, (GstBufferListFunc) gst_cef_demux_prepare_audio_buffer, &push_data);
+
+  return gst_cef_demux_combine_flow (demux, demux->asrcpad,
+      gst_pad_push_list (demux->asrcpad, audio));
+}
+
+static gboolean
+gst_cef_demux_remove_audio_meta (GstBuffer *buffer, GstMeta **meta, gpointer user_data)
+{
+  if ((*meta)->info->api == GST_CEF_AUDIO_META_API_TYPE)
+    *meta = NULL;
 
-  *buffer = NULL;
   return TRUE;
 }
 
+/* Moves audio along with the buffer that carried it, when that got
+ * restamped since the meta was attached */
+static GstClockTimeDiff
+gst_cef_demux_get_audio_delta (GstCefAudioMeta *ameta, GstBuffer *buffer)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (ameta->pts) || !GST_BUFFER_PTS_IS_VALID (buffer))
+    return 0;
+
+  return GST_CLOCK_DIFF (ameta->pts, GST_BUFFER_PTS (buffer));
+}
+
+static GstBuffer *
+gst_cef_demux_rebase_audio_buffer (GstBuffer *buffer, GstClockTimeDiff delta)
+{
+  GstClockTime pts = GST_BUFFER_PTS (buffer);
+
+  buffer = gst_buffer_copy (buffer);
+  if (GST_CLOCK_TIME_IS_VALID (pts))
+    GST_BUFFER_PTS (buffer) = delta < 0 && (GstClockTime) -delta > pts ? 0 : pts + delta;
+
+  return buffer;
+}
+
+/* Takes the audio lists out of the metas of @buffer, merged into one,
+ * so that the video goes downstream without keeping them alive. The
+ * lists are only referenced, unless their timestamps need rebasing,
+ * and @buffer only copied (sharing them) if shared. */
+static GstBufferList *
+gst_cef_demux_take_audio (GstBuffer **buffer)
+{
+  GstBufferList *audio = NULL;
+  GstMeta *meta;
+  gpointer state = NULL;
+  gboolean found = FALSE;
+
+  while ((meta = gst_buffer_iterate_meta_filtered (*buffer, &state, GST_CEF_AUDIO_META_API_TYPE)) != NULL) {
+    GstCefAudioMeta *ameta = (GstCefAudioMeta *) meta;
+    GstClockTimeDiff delta;
+    guint i, n;
+
+    found = TRUE;
+    if (!ameta->buffers)
+      continue;
+
+    delta = gst_cef_demux_get_audio_delta (ameta, *buffer);
+    n = gst_buffer_list_length (ameta->buffers);
+
+    if (!audio && !delta) {
+      audio = gst_buffer_list_ref (ameta->buffers);
+      continue;
+    }
+
+    if (delta)
+      GST_LOG ("Moving audio by %" GST_STIME_FORMAT " along with its buffer", GST_STIME_ARGS (delta));
+
+    if (audio)
+      audio = gst_buffer_list_make_writable (audio);
+    else
+      audio = gst_buffer_list_new_sized (n);
+
+    for (i = 0; i < n; i++) {
+      GstBuffer *abuf = gst_buffer_list_get (ameta->buffers, i);
+
+      gst_buffer_list_add (audio, delta ? gst_cef_demux_rebase_audio_buffer (abuf, delta) :
+          gst_buffer_ref (abuf));
+    }
+  }
+
+  if (!found)
+    return NULL;
+
+  *buffer = gst_buffer_make_writable (*buffer);
+  gst_buffer_foreach_meta (*buffer, (GstBufferForeachMetaFunc) gst_cef_demux_remove_audio_meta, NULL);
+
+  return audio;
+}
+
+/* Only renegotiates when CEF did not produce what we asked for, and
+ * converts instead when the output format is fixed */
 static void
 gst_cef_demux_update_audio_caps (GstCefDemux *demux, const GstStructure *s)
 {
   GstCaps *caps;
-  GstEvent *event;
   gint channels, rate;
 
   gst_structure_get_int (s, "channels", &channels);
   gst_structure_get_int (s, "rate", &rate);
 
-  caps = gst_caps_new_simple ("audio/x-raw",
-      "format", G_TYPE_STRING, "F32LE",
-      "rate", G_TYPE_INT, rate,
-      "channels", G_TYPE_INT, channels,
-      "channel-mask", GST_TYPE_BITMASK, gst_audio_channel_get_fallback_mask (channels),
-      "layout", G_TYPE_STRING, "interleaved",
+  gst_cef_demux_clear_audio_converter (demux);
+
+  if (GST_AUDIO_INFO_IS_VALID (&demux->audio_info) &&
+      GST_AUDIO_INFO_RATE (&demux->audio_info) == rate &&
+      GST_AUDIO_INFO_CHANNELS (&demux->audio_info) == channels)
+    return;
+
+  GST_INFO_OBJECT (demux, "CEF streams %d channels at %d Hz", channels, rate);
+
+  if (demux->fixed_audio_caps && GST_AUDIO_INFO_IS_VALID (&demux->audio_info)) {
+    gst_audio_info_set_format (&demux->cef_audio_info, GST_AUDIO_FORMAT_F32LE, rate, channels, NULL);
+    demux->audio_converter = gst_audio_converter_new (GST_AUDIO_CONVERTER_FLAG_NONE,
+        &demux->cef_audio_info, &demux->audio_info, NULL);
+    if (demux->audio_converter)
+      return;
+
+    GST_WARNING_OBJECT (demux, "Cannot convert to the fixed output format, renegotiating");
+  }
+
+  caps = gst_cef_demux_new_audio_caps (rate, channels);
+  gst_audio_info_from_caps (&demux->audio_info, caps);
+  gst_pad_push_event (demux->asrcpad, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+}
+
+/* Keep the audio branch advancing along with video while no audio
+ * comes in. While CEF streams audio, packets are timestamped earlier
+ * than the video frame they come with, gaps up to the video would
+ * overlap them. */
+static void
+gst_cef_demux_push_audio_gap (GstCefDemux *demux, GstClockTime pts, GstClockTime video_duration)
+{
+  if (demux->audio_streaming)
+    return;
+
+  if (!GST_CLOCK_TIME_IS_VALID(demux->last_audio_time) || demux->last_audio_time < pts) {
+    GstClockTime duration, timestamp;
+
+    if (!GST_CLOCK_TIME_IS_VALID(demux->last_audio_time)) {
+      timestamp = pts;
+      duration = video_duration;
+    } else {
+      timestamp = demux->last_audio_time;
+      duration = pts - demux->last_audio_time;
+    }
+
+    gst_pad_push_event (demux->asrcpad, gst_event_new_gap (timestamp, duration));
+
+    demux->last_audio_time = pts;
+  }
+}
+
+/* Same as cefsrc: the downstream video pool when there is one, with
+ * room for the output we keep around */
+static gboolean
+gst_cef_demux_decide_scaled_allocation (GstCefDemuxScaledPad *spad, GstCaps *caps)
+{
+  GstQuery *query = gst_query_new_allocation (caps, TRUE);
+  GstBufferPool *pool = NULL;
+  GstAllocator *allocator = NULL;
+  GstAllocationParams params;
+  GstStructure *config;
+  guint size, min = 0, max = 0;
+
+  if (!gst_pad_peer_query (GST_PAD (spad), query))
+    GST_DEBUG_OBJECT (spad, "Allocation query failed");
+
+  size = GST_VIDEO_INFO_SIZE (&spad->info);
+  if (gst_query_get_n_allocation_pools (query) > 0) {
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+    size = MAX (size, (guint) GST_VIDEO_INFO_SIZE (&spad->info));
+  }
+
+  if (gst_query_get_n_allocation_params (query) > 0)
+    gst_query_parse_nth_allocation_param (query, 0, &allocator, &params);
+  else
+    gst_allocation_params_init (&params);
+
+  min += 1;
+  if (max && max < min)
+    max = min;
+
+  if (pool && !GST_IS_VIDEO_BUFFER_POOL (pool))
+    gst_clear_object (&pool);
+  if (!pool)
+    pool = gst_video_buffer_pool_new ();
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size, min, max);
+  gst_buffer_pool_config_set_allocator (config, allocator, &params);
+  if (gst_query_find_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL))
+    gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+
+  if (!gst_buffer_pool_set_config (pool, config)) {
+    config = gst_buffer_pool_get_config (pool);
+    if (!gst_buffer_pool_config_validate_params (config, caps, size, min, max) ||
+        !gst_buffer_pool_set_config (pool, config)) {
+      GST_WARNING_OBJECT (spad, "Failed to configure the buffer pool");
+      gst_clear_object (&pool);
+    }
+  }
+
+  if (pool && !gst_buffer_pool_set_active (pool, TRUE)) {
+    GST_WARNING_OBJECT (spad, "Failed to activate the buffer pool");
+    gst_clear_object (&pool);
+  }
+
+  gst_cef_demux_scaled_pad_clear_pool (spad);
+  spad->pool = pool;
+
+  gst_clear_object (&allocator);
+  gst_query_unref (query);
+
+  return pool != NULL;
+}
+
+/* Output caps are the input caps with the size downstream prefers,
+ * the input size when it does not care */
+static gboolean
+gst_cef_demux_negotiate_scaled_pad (GstCefDemux *demux, GstCefDemuxScaledPad *spad)
+{
+  GstCaps *filter, *caps;
+  GstStructure *s;
+  gboolean ret;
+
+  filter = gst_video_info_to_caps (&demux->video_info);
+  gst_caps_set_simple (filter,
+      "width", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+      "height", GST_TYPE_INT_RANGE, 1, G_MAXINT,
       NULL);
-  event = gst_event_new_caps (caps);
-  gst_pad_push_event (demux->asrcpad, event);
+  caps = gst_pad_peer_query_caps (GST_PAD (spad), filter);
+  gst_caps_unref (filter);
+
+  if (gst_caps_is_empty (caps)) {
+    GST_WARNING_OBJECT (spad, "Downstream accepts no scaled version of the input");
+    gst_caps_unref (caps);
+    return FALSE;
+  }
+
+  caps = gst_caps_truncate (caps);
+  caps = gst_caps_make_writable (caps);
+  s = gst_caps_get_structure (caps, 0);
+  gst_structure_fixate_field_nearest_int (s, "width", GST_VIDEO_INFO_WIDTH (&demux->video_info));
+  gst_structure_fixate_field_nearest_int (s, "height", GST_VIDEO_INFO_HEIGHT (&demux->video_info));
+  caps = gst_caps_fixate (caps);
+
+  ret = gst_video_info_from_caps (&spad->info, caps);
+  if (ret) {
+    GST_INFO_OBJECT (spad, "Scaling to %" GST_PTR_FORMAT, caps);
+    gst_buffer_replace (&spad->last, NULL);
+    gst_pad_push_event (GST_PAD (spad), gst_event_new_caps (caps));
+    ret = gst_cef_demux_decide_scaled_allocation (spad, caps);
+  }
   gst_caps_unref (caps);
+
+  return ret;
+}
+
+static gboolean
+gst_cef_demux_prepare_scaled_pad (GstCefDemux *demux, GstCefDemuxScaledPad *spad)
+{
+  GstPad *pad = GST_PAD (spad);
+  GstSegment segment;
+
+  if (spad->need_stream_start) {
+    gchar *stream_id = g_strdup_printf ("cef%s", GST_PAD_NAME (pad));
+
+    gst_pad_push_event (pad, gst_event_new_stream_start (stream_id));
+    g_free (stream_id);
+    spad->need_stream_start = FALSE;
+  }
+
+  if (spad->need_caps) {
+    if (!gst_cef_demux_negotiate_scaled_pad (demux, spad))
+      return FALSE;
+    spad->need_caps = FALSE;
+  }
+
+  if (spad->need_segment) {
+    gst_segment_init (&segment, GST_FORMAT_TIME);
+    gst_pad_push_event (pad, gst_event_new_segment (&segment));
+    spad->need_segment = FALSE;
+  }
+
+  return TRUE;
+}
+
+/* A pool buffer, holding a copy of @last when given */
+static GstFlowReturn
+gst_cef_demux_acquire_scaled (GstCefDemuxScaledPad *spad, GstBuffer *last, GstBuffer **out)
+{
+  GstVideoFrame in_frame, out_frame;
+  GstFlowReturn ret;
+
+  ret = gst_buffer_pool_acquire_buffer (spad->pool, out, NULL);
+  if (ret != GST_FLOW_OK || !last)
+    return ret;
+
+  if (!gst_video_frame_map (&in_frame, &spad->info, last, GST_MAP_READ))
+    goto map_failed;
+  if (!gst_video_frame_map (&out_frame, &spad->info, *out, GST_MAP_WRITE)) {
+    gst_video_frame_unmap (&in_frame);
+    goto map_failed;
+  }
+
+  gst_video_frame_copy (&out_frame, &in_frame);
+
+  gst_video_frame_unmap (&out_frame);
+  gst_video_frame_unmap (&in_frame);
+
+  return GST_FLOW_OK;
+
+map_failed:
+  GST_ERROR_OBJECT (spad, "Failed to map the last output");
+  gst_clear_buffer (out);
+  return GST_FLOW_ERROR;
+}
+
+/* Only the regions cefsrc reported as damaged get scaled again, on top
+ * of the previous output when downstream is done with it, or on a copy */
+static GstFlowReturn
+gst_cef_demux_push_scaled (GstCefDemux *demux, GstCefDemuxScaledPad *spad, GstBuffer *buffer)
+{
+  GstCefDamageMeta *dmeta = gst_buffer_get_cef_damage_meta (buffer);
+  GstVideoRectangle rects[GST_CEF_DAMAGE_META_MAX_RECTS];
+  GstVideoFrame in_frame, out_frame;
+  GstBuffer *out = NULL;
+  GstFlowReturn ret;
+  guint i, n_rects = 0;
+
+  if (!gst_pad_is_linked (GST_PAD (spad))) {
+    gst_buffer_replace (&spad->last, NULL);
+    return GST_FLOW_NOT_LINKED;
+  }
+
+  if (!gst_cef_demux_prepare_scaled_pad (demux, spad))
+    return GST_FLOW_NOT_NEGOTIATED;
+
+  if (!spad->last || !dmeta) {
+    ret = gst_cef_demux_acquire_scaled (spad, NULL, &out);
+    if (ret != GST_FLOW_OK)
+      return ret;
+    rects[0].x = 0;
+    rects[0].y = 0;
+    rects[0].w = GST_VIDEO_INFO_WIDTH (&spad->info);
+    rects[0].h = GST_VIDEO_INFO_HEIGHT (&spad->info);
+    n_rects = 1;
+  } else {
+    for (i = 0; i < dmeta->n_rects; i++) {
+      gst_cef_scale_damage_rect (&demux->video_info, &spad->info, &dmeta->rects[i], &rects[n_rects]);
+      if (rects[n_rects].w > 0 && rects[n_rects].h > 0)
+        n_rects++;
+    }
+
+    if (!n_rects) {
+      out = gst_buffer_copy (spad->last);
+    } else if (gst_buffer_is_writable (spad->last) && gst_buffer_is_all_memory_writable (spad->last)) {
+      out = spad->last;
+      spad->last = NULL;
+    } else {
+      ret = gst_cef_demux_acquire_scaled (spad, spad->last, &out);
+      if (ret != GST_FLOW_OK)
+        return ret;
+    }
+  }
+
+  if (n_rects) {
+    if (!gst_video_frame_map (&in_frame, &demux->video_info, buffer, GST_MAP_READ)) {
+      gst_buffer_unref (out);
+      return GST_FLOW_ERROR;
+    }
+    if (!gst_video_frame_map (&out_frame, &spad->info, out, GST_MAP_WRITE)) {
+      gst_video_frame_unmap (&in_frame);
+      gst_buffer_unref (out);
+      return GST_FLOW_ERROR;
+    }
+
+    for (i = 0; i < n_rects; i++)
+      gst_cef_scale_rect (&in_frame, &out_frame, &rects[i], gst_cef_stripe_pool_get_default ());
+
+    gst_video_frame_unmap (&out_frame);
+    gst_video_frame_unmap (&in_frame);
+  }
+
+  gst_buffer_copy_into (out, buffer, (GstBufferCopyFlags) (GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS), 0, -1);
+
+  dmeta = gst_buffer_get_cef_damage_meta (out);
+  if (dmeta) {
+    memcpy (dmeta->rects, rects, n_rects * sizeof (GstVideoRectangle));
+    dmeta->n_rects = n_rects;
+  } else {
+    gst_buffer_add_cef_damage_meta (out, rects, n_rects);
+  }
+
+  /* Keeping a reference is what lets the next damage be scaled on top of
+   * this output, the price is that downstream never gets a writable buffer
+   * and elements working in place copy it */
+  gst_buffer_replace (&spad->last, out);
+
+  return gst_pad_push (GST_PAD (spad), out);
 }
 
 static GstFlowReturn
 gst_cef_demux_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
 {
   GstCefDemux *demux = (GstCefDemux *) parent;
-  GstMeta *meta;
-  gpointer state = NULL;
-  GList *tmp;
+  GstBufferList *audio;
+  GList *tmp, *scaled_pads;
   GstFlowReturn ret = GST_FLOW_OK;
 
   gst_cef_demux_push_events (demux);
@@ -208,42 +951,33 @@ gst_cef_demux_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
   g_list_free_full (demux->cef_audio_stream_start_events, (GDestroyNotify) gst_event_unref);
   demux->cef_audio_stream_start_events = NULL;
 
-  while ((meta = gst_buffer_iterate_meta_filtered (buffer, &state, GST_CEF_AUDIO_META_API_TYPE)) != NULL) {
-    AudioPushData push_data;
-    GstCefAudioMeta *ameta = (GstCefAudioMeta *) meta;
-
-    push_data.demux = demux;
-    push_data.flow_combiner = demux->flow_combiner;
-    gst_buffer_list_foreach (ameta->buffers, (GstBufferListFunc) gst_cef_demux_push_audio_buffer, &push_data);
-    if (push_data.combined != GST_FLOW_OK) {
-      ret = push_data.combined;
+  audio = gst_cef_demux_take_audio (&buffer);
+  if (audio) {
+    ret = gst_cef_demux_push_audio (demux, audio);
+    if (ret != GST_FLOW_OK)
       goto done;
-    }
   }
 
-  ret = gst_flow_combiner_update_pad_flow (demux->flow_combiner, demux->vsrcpad,
-      gst_pad_push (demux->vsrcpad, buffer));
+  /* cefsrc audio-mode=immediate sends audio between frames this way */
+  if (gst_buffer_n_memory (buffer) == 0 && GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_GAP))
+    goto done;
 
-  if (!GST_CLOCK_TIME_IS_VALID(demux->last_audio_time) || demux->last_audio_time < GST_BUFFER_PTS (buffer)) {
-    GstClockTime duration, timestamp;
+  ret = gst_cef_demux_combine_flow (demux, demux->vsrcpad,
+      gst_pad_push (demux->vsrcpad, gst_buffer_ref (buffer)));
 
-    if (!GST_CLOCK_TIME_IS_VALID(demux->last_audio_time)) {
-      timestamp = GST_BUFFER_PTS (buffer);
-      duration = GST_BUFFER_DURATION (buffer);
-    } else {
-      timestamp = demux->last_audio_time;
-      duration = GST_BUFFER_PTS (buffer) - demux->last_audio_time;
-    }
+  scaled_pads = gst_cef_demux_get_scaled_pads (demux);
+  for (tmp = scaled_pads; tmp; tmp = tmp->next) {
+    GstCefDemuxScaledPad *spad = (GstCefDemuxScaledPad *) tmp->data;
 
-    gst_pad_push_event (demux->asrcpad, gst_event_new_gap (timestamp, duration));
-
-    demux->last_audio_time = GST_BUFFER_PTS (buffer);
+    ret = gst_cef_demux_combine_flow (demux, GST_PAD (spad),
+        gst_cef_demux_push_scaled (demux, spad, buffer));
   }
+  g_list_free_full (scaled_pads, (GDestroyNotify) gst_object_unref);
 
-  if (ret != GST_FLOW_OK)
-    goto done;
+  gst_cef_demux_push_audio_gap (demux, GST_BUFFER_PTS (buffer), GST_BUFFER_DURATION (buffer));
 
 done:
+  gst_buffer_unref (buffer);
   return ret;
 }
 
@@ -251,6 +985,7 @@ static gboolean
 gst_cef_demux_sink_event (GstPad *pad, GstObject *parent, GstEvent *event)
 {
   GstCefDemux *demux = (GstCefDemux *) parent;
+  GList *tmp, *scaled_pads;
 
   switch (GST_EVENT_TYPE (event)) {
     case GST_EVENT_CUSTOM_DOWNSTREAM:
@@ -259,14 +994,52 @@ gst_cef_demux_sink_event (GstPad *pad, GstObject *parent, GstEvent *event)
 
       if (gst_structure_has_name (s, "cef-audio-stream-start")) {
         demux->cef_audio_stream_start_events = g_list_append (demux->cef_audio_stream_start_events, event);
+        demux->audio_streaming = TRUE;
         event = NULL;
+      } else if (gst_structure_has_name (s, "cef-audio-stream-stop")) {
+        demux->audio_streaming = FALSE;
+        gst_event_replace (&event, NULL);
+      }
+      break;
+    }
+    case GST_EVENT_GAP:
+    {
+      GstClockTime timestamp, duration;
+
+      /* cefsrc sends these in place of repeated video frames */
+      gst_event_parse_gap (event, &timestamp, &duration);
+      gst_cef_demux_push_events (demux);
+
+      scaled_pads = gst_cef_demux_get_scaled_pads (demux);
+      for (tmp = scaled_pads; tmp; tmp = tmp->next) {
+        GstCefDemuxScaledPad *spad = (GstCefDemuxScaledPad *) tmp->data;
+
+        if (gst_cef_demux_prepare_scaled_pad (demux, spad))
+          gst_pad_push_event (GST_PAD (spad), gst_event_ref (event));
       }
+      g_list_free_full (scaled_pads, (GDestroyNotify) gst_object_unref);
+
+      gst_pad_push_event (demux->vsrcpad, event);
+      gst_cef_demux_push_audio_gap (demux, timestamp, duration);
+      event = NULL;
       break;
     }
     case GST_EVENT_CAPS:
+    {
+      GstCaps *caps;
+
+      gst_event_parse_caps (event, &caps);
+      gst_video_info_from_caps (&demux->video_info, caps);
+
+      GST_OBJECT_LOCK (demux);
+      for (tmp = demux->scaled_pads; tmp; tmp = tmp->next)
+        ((GstCefDemuxScaledPad *) tmp->data)->need_caps = TRUE;
+      GST_OBJECT_UNLOCK (demux);
+
       demux->vcaps_event = event;
       demux->need_caps = TRUE;
       event = NULL;
+    }
     /* We send our own */
     case GST_EVENT_SEGMENT:
     case GST_EVENT_STREAM_START:
@@ -293,6 +1066,15 @@ gst_cef_demux_sink_query (GstPad *pad, GstObject *parent, GstQuery *query)
     case GST_QUERY_CAPS:
       ret = gst_pad_peer_query(demux->vsrcpad, query);
       break;
+    case GST_QUERY_CUSTOM:
+      /* cefsrc only sends audio in empty video buffers when we are the
+       * ones taking them apart */
+      if (gst_structure_has_name (gst_query_get_structure (query), "cef-audio-only-buffers")) {
+        ret = TRUE;
+        break;
+      }
+      ret = gst_pad_query_default(pad, parent, query);
+      break;
     default:
       ret = gst_pad_query_default(pad, parent, query);
       break;
@@ -312,8 +1094,21 @@ gst_cef_demux_change_state (GstElement * element, GstStateChange transition)
 
   switch (transition) {
   case GST_STATE_CHANGE_PAUSED_TO_READY:
+  {
+    GList *tmp;
+
+    GST_OBJECT_LOCK (demux);
     gst_flow_combiner_reset (demux->flow_combiner);
+    for (tmp = demux->scaled_pads; tmp; tmp = tmp->next)
+      gst_cef_demux_scaled_pad_reset ((GstCefDemuxScaledPad *) tmp->data);
+    GST_OBJECT_UNLOCK (demux);
+    demux->audio_streaming = FALSE;
+    demux->audio_consumed = TRUE;
+    demux->n_audio_checks = 0;
+    gst_audio_info_init (&demux->audio_info);
+    gst_cef_demux_clear_audio_converter (demux);
     break;
+  }
   case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
     demux->need_discont = TRUE;
     break;
@@ -324,6 +1119,64 @@ gst_cef_demux_change_state (GstElement * element, GstStateChange transition)
   return result;
 }
 
+static GstPad *
+gst_cef_demux_request_new_pad (GstElement *element, GstPadTemplate *templ,
+    const gchar *name, const GstCaps *caps)
+{
+  GstCefDemux *demux = GST_CEF_DEMUX (element);
+  GstPad *pad;
+  gchar *pad_name;
+  guint id;
+
+  GST_OBJECT_LOCK (demux);
+  if (name && sscanf (name, "video_%u", &id) == 1) {
+    demux->next_pad_id = MAX (demux->next_pad_id, id + 1);
+    pad_name = g_strdup (name);
+  } else {
+    pad_name = g_strdup_printf ("video_%u", demux->next_pad_id++);
+  }
+  GST_OBJECT_UNLOCK (demux);
+
+  pad = GST_PAD (g_object_new (gst_cef_demux_scaled_pad_get_type (),
+      "name", pad_name, "direction", GST_PAD_SRC, "template", templ, NULL));
+  g_free (pad_name);
+
+  if (!gst_element_add_pad (element, pad)) {
+    gst_object_unref (pad);
+    return NULL;
+  }
+
+  /* Only visible to the streaming thread once active */
+  GST_OBJECT_LOCK (demux);
+  demux->scaled_pads = g_list_append (demux->scaled_pads, gst_object_ref (pad));
+  gst_flow_combiner_add_pad (demux->flow_combiner, pad);
+  GST_OBJECT_UNLOCK (demux);
+
+  GST_DEBUG_OBJECT (demux, "Added %" GST_PTR_FORMAT, pad);
+
+  return pad;
+}
+
+static void
+gst_cef_demux_release_pad (GstElement *element, GstPad *pad)
+{
+  GstCefDemux *demux = GST_CEF_DEMUX (element);
+  GList *link;
+
+  GST_OBJECT_LOCK (demux);
+  link = g_list_find (demux->scaled_pads, pad);
+  if (link) {
+    demux->scaled_pads = g_list_delete_link (demux->scaled_pads, link);
+    gst_flow_combiner_remove_pad (demux->flow_combiner, pad);
+  }
+  GST_OBJECT_UNLOCK (demux);
+
+  if (!link)
+    return;
+
+  gst_element_remove_pad (element, pad);
+  gst_object_unref (pad);
+}
 
 static void
 gst_cef_demux_init (GstCefDemux * demux)
@@ -346,12 +1199,25 @@ gst_cef_demux_init (GstCefDemux * demux)
   gst_flow_combiner_add_pad (demux->flow_combiner, demux->asrcpad);
 
   gst_audio_info_init (&demux->audio_info);
+  demux->audio_rate = DEFAULT_AUDIO_RATE;
+  demux->audio_channels = DEFAULT_AUDIO_CHANNELS;
+  demux->audio_consumed = TRUE;
+  demux->n_audio_checks = 0;
+  demux->fixed_audio_caps = DEFAULT_FIXED_AUDIO_CAPS;
+  gst_audio_info_init (&demux->cef_audio_info);
+  demux->audio_converter = NULL;
+  demux->audio_pool = NULL;
+  demux->audio_pool_size = 0;
+  gst_video_info_init (&demux->video_info);
+  demux->scaled_pads = NULL;
+  demux->next_pad_id = 0;
 
   demux->need_stream_start = TRUE;
   demux->need_caps = TRUE;
   demux->need_segment = TRUE;
   demux->need_discont = TRUE;
   demux->last_audio_time = GST_CLOCK_TIME_NONE;
+  demux->audio_streaming = FALSE;
 }
 
 static void
@@ -361,7 +1227,44 @@ gst_cef_demux_finalize (GObject *object)
 
   g_list_free_full (demux->cef_audio_stream_start_events, (GDestroyNotify) gst_event_unref);
   demux->cef_audio_stream_start_events = NULL;
+  g_list_free_full (demux->scaled_pads, (GDestroyNotify) gst_object_unref);
+  demux->scaled_pads = NULL;
   gst_flow_combiner_free (demux->flow_combiner);
+  gst_cef_demux_clear_audio_converter (demux);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_cef_demux_set_property (GObject * object, guint prop_id, const GValue * value,
+    GParamSpec * pspec)
+{
+  GstCefDemux *demux = GST_CEF_DEMUX (object);
+
+  switch (prop_id) {
+    case PROP_FIXED_AUDIO_CAPS:
+      demux->fixed_audio_caps = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_cef_demux_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstCefDemux *demux = GST_CEF_DEMUX (object);
+
+  switch (prop_id) {
+    case PROP_FIXED_AUDIO_CAPS:
+      g_value_set_boolean (value, demux->fixed_audio_caps);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
 }
 
 static void
@@ -371,8 +1274,19 @@ gst_cef_demux_class_init (GstCefDemuxClass * klass)
   GstElementClass *gstelement_class = GST_ELEMENT_CLASS(klass);
 
   gobject_class->finalize = gst_cef_demux_finalize;
+  gobject_class->set_property = gst_cef_demux_set_property;
+  gobject_class->get_property = gst_cef_demux_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_FIXED_AUDIO_CAPS,
+      g_param_spec_boolean ("fixed-audio-caps", "fixed-audio-caps",
+          "Keep the audio caps negotiated at startup, converting whatever "
+          "CEF streams into them",
+          DEFAULT_FIXED_AUDIO_CAPS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
 
   gstelement_class->change_state = gst_cef_demux_change_state;
+  gstelement_class->request_new_pad = gst_cef_demux_request_new_pad;
+  gstelement_class->release_pad = gst_cef_demux_release_pad;
 
   gst_element_class_set_static_metadata (gstelement_class,
       "Chromium Embedded Framework demuxer", "Demuxer/Audio/Video",
@@ -384,4 +1298,6 @@ gst_cef_demux_class_init (GstCefDemuxClass * klass)
       &gst_cef_demux_video_src_template);
   gst_element_class_add_static_pad_template (gstelement_class,
       &gst_cef_demux_audio_src_template);
+  gst_element_class_add_static_pad_template (gstelement_class,
+      &gst_cef_demux_scaled_src_template);
 }
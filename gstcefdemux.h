@@ -4,6 +4,7 @@
 #include <gst/gst.h>
 #include <gst/base/gstflowcombiner.h>
 #include <gst/audio/audio.h>
+#include <gst/video/video.h>
 
 G_BEGIN_DECLS
 
@@ -33,8 +34,33 @@ struct _GstCefDemux {
   GList *cef_audio_stream_start_events;
   GstEvent *vcaps_event;
   GstFlowCombiner *flow_combiner;
+  /* End of the last audio pushed, buffer or gap */
   GstClockTime last_audio_time;
+  /* Between cef-audio-stream-start and cef-audio-stream-stop */
+  gboolean audio_streaming;
   GstAudioInfo audio_info;
+  /* Audio format picked from what downstream accepts, cefsrc gets CEF
+   * to produce it when possible */
+  gint audio_rate;
+  gint audio_channels;
+  /* Whether anything consumes the audio, checked every
+   * CEF_DEMUX_AUDIO_CHECK_INTERVAL buffers and gaps */
+  gboolean audio_consumed;
+  guint n_audio_checks;
+  /* With fixed-audio-caps, what CEF streams when it differs from the
+   * output format, converted by audio_converter */
+  gboolean fixed_audio_caps;
+  GstAudioInfo cef_audio_info;
+  GstAudioConverter *audio_converter;
+  /* Output buffers for audio_converter, audio_pool_size bytes each */
+  GstBufferPool *audio_pool;
+  gsize audio_pool_size;
+  /* Input video info, from the last caps event */
+  GstVideoInfo video_info;
+  /* video_%u request pads, protected by the object lock along with
+   * the flow combiner */
+  GList *scaled_pads;
+  guint next_pad_id;
 };
 
 struct _GstCefDemuxClass {
@@ -0,0 +1,165 @@
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GST_CEF_INTERLEAVE_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define GST_CEF_INTERLEAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "gstcefinterleave.h"
+
+/* Interleaves frames [@start, @frames) */
+static void
+interleave_scalar (const gfloat * const *planes, gfloat *dst, gint channels,
+    gint start, gint frames)
+{
+  gint i, c;
+
+  for (i = start; i < frames; i++) {
+    for (c = 0; c < channels; c++)
+      dst[i * channels + c] = planes[c][i];
+  }
+}
+
+#if defined(GST_CEF_INTERLEAVE_SSE2) || defined(GST_CEF_INTERLEAVE_NEON)
+
+/* The kernels below only need 4 float lanes, loads, stores and zips */
+#if defined(GST_CEF_INTERLEAVE_SSE2)
+
+typedef __m128 v4f;
+
+#define LOAD(p) _mm_loadu_ps (p)
+#define STORE(p, v) _mm_storeu_ps ((p), (v))
+#define STORE_LO2(p, v) _mm_storel_pi ((__m64 *) (p), (v))
+#define STORE_HI2(p, v) _mm_storeh_pi ((__m64 *) (p), (v))
+#define ZIP_LO(a, b) _mm_unpacklo_ps ((a), (b))
+#define ZIP_HI(a, b) _mm_unpackhi_ps ((a), (b))
+
+#else
+
+typedef float32x4_t v4f;
+
+#define LOAD(p) vld1q_f32 (p)
+#define STORE(p, v) vst1q_f32 ((p), (v))
+#define STORE_LO2(p, v) vst1_f32 ((p), vget_low_f32 (v))
+#define STORE_HI2(p, v) vst1_f32 ((p), vget_high_f32 (v))
+#define ZIP_LO(a, b) vzipq_f32 ((a), (b)).val[0]
+#define ZIP_HI(a, b) vzipq_f32 ((a), (b)).val[1]
+
+#endif
+
+/* Loads 4 frames of 4 consecutive planes, @out[k] holding frame k */
+static inline void
+load_transposed (const gfloat * const *planes, gint i, v4f out[4])
+{
+  v4f a = LOAD (planes[0] + i), b = LOAD (planes[1] + i);
+  v4f c = LOAD (planes[2] + i), d = LOAD (planes[3] + i);
+  v4f ac_lo = ZIP_LO (a, c), ac_hi = ZIP_HI (a, c);
+  v4f bd_lo = ZIP_LO (b, d), bd_hi = ZIP_HI (b, d);
+
+  out[0] = ZIP_LO (ac_lo, bd_lo);
+  out[1] = ZIP_HI (ac_lo, bd_lo);
+  out[2] = ZIP_LO (ac_hi, bd_hi);
+  out[3] = ZIP_HI (ac_hi, bd_hi);
+}
+
+static gint
+interleave_2 (const gfloat * const *planes, gfloat *dst, gint frames)
+{
+  gint i;
+
+  for (i = 0; i + 4 <= frames; i += 4) {
+    v4f l = LOAD (planes[0] + i), r = LOAD (planes[1] + i);
+
+    STORE (dst + 2 * i, ZIP_LO (l, r));
+    STORE (dst + 2 * i + 4, ZIP_HI (l, r));
+  }
+
+  return i;
+}
+
+static gint
+interleave_6 (const gfloat * const *planes, gfloat *dst, gint frames)
+{
+  gint i, k;
+
+  for (i = 0; i + 4 <= frames; i += 4) {
+    v4f front[4], lo, hi;
+    v4f e = LOAD (planes[4] + i), f = LOAD (planes[5] + i);
+    gfloat *out = dst + 6 * i;
+
+    load_transposed (planes, i, front);
+    lo = ZIP_LO (e, f);
+    hi = ZIP_HI (e, f);
+
+    for (k = 0; k < 4; k++)
+      STORE (out + 6 * k, front[k]);
+    STORE_LO2 (out + 4, lo);
+    STORE_HI2 (out + 10, lo);
+    STORE_LO2 (out + 16, hi);
+    STORE_HI2 (out + 22, hi);
+  }
+
+  return i;
+}
+
+static gint
+interleave_8 (const gfloat * const *planes, gfloat *dst, gint frames)
+{
+  gint i, k;
+
+  for (i = 0; i + 4 <= frames; i += 4) {
+    v4f front[4], back[4];
+    gfloat *out = dst + 8 * i;
+
+    load_transposed (planes, i, front);
+    load_transposed (planes + 4, i, back);
+
+    for (k = 0; k < 4; k++) {
+      STORE (out + 8 * k, front[k]);
+      STORE (out + 8 * k + 4, back[k]);
+    }
+  }
+
+  return i;
+}
+
+#else
+
+#define interleave_2(planes, dst, frames) 0
+#define interleave_6(planes, dst, frames) 0
+#define interleave_8(planes, dst, frames) 0
+
+#endif
+
+/* Interleaves @frames samples of @channels planes into @dst. Stereo,
+ * 5.1 and 7.1 have vectorized kernels, other layouts and the frames
+ * left over by those go through the scalar loop. */
+void
+gst_cef_interleave_f32 (const gfloat * const *planes, gfloat *dst,
+    gint channels, gint frames)
+{
+  gint done;
+
+  switch (channels) {
+    case 1:
+      memcpy (dst, planes[0], frames * sizeof (gfloat));
+      return;
+    case 2:
+      done = interleave_2 (planes, dst, frames);
+      break;
+    case 6:
+      done = interleave_6 (planes, dst, frames);
+      break;
+    case 8:
+      done = interleave_8 (planes, dst, frames);
+      break;
+    default:
+      done = 0;
+      break;
+  }
+
+  interleave_scalar (planes, dst, channels, done, frames);
+}
@@ -0,0 +1,13 @@
+#ifndef __GST_CEF_INTERLEAVE_H__
+#define __GST_CEF_INTERLEAVE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+void gst_cef_interleave_f32 (const gfloat * const *planes, gfloat *dst,
+    gint channels, gint frames);
+
+G_END_DECLS
+
+#endif /* __GST_CEF_INTERLEAVE_H__ */
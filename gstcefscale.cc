@@ -0,0 +1,352 @@
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GST_CEF_SCALE_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define GST_CEF_SCALE_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "gstcefscale.h"
+#include "gstcefconvert.h"
+
+/* Bilinear weights are 7 bit, so a horizontally filtered sample still
+ * fits in a signed 16 bit lane */
+#define WEIGHT_BITS 7
+#define WEIGHT_ONE (1 << WEIGHT_BITS)
+#define VSHIFT (2 * WEIGHT_BITS)
+#define VROUND (1 << (VSHIFT - 1))
+
+/* Below this many output pixels, a rectangle is not worth waking up
+ * workers for */
+#define STRIPE_MIN_PIXELS (256 * 256)
+
+typedef struct {
+  gint pixel_size;
+  gint sub;
+} PlaneLayout;
+
+static guint
+get_planes (GstVideoFormat format, PlaneLayout planes[3])
+{
+  switch (format) {
+    case GST_VIDEO_FORMAT_I420:
+      planes[0] = { 1, 0 };
+      planes[1] = { 1, 1 };
+      planes[2] = { 1, 1 };
+      return 3;
+    case GST_VIDEO_FORMAT_NV12:
+      planes[0] = { 1, 0 };
+      planes[1] = { 2, 1 };
+      return 2;
+    case GST_VIDEO_FORMAT_Y444:
+      planes[0] = planes[1] = planes[2] = { 1, 0 };
+      return 3;
+    default:
+      planes[0] = { 4, 0 };
+      return 1;
+  }
+}
+
+/* Source position sampled for output position @x, in 1 / WEIGHT_ONE
+ * units, with pixel centers lined up */
+static void
+map_position (gint x, gint in_size, gint out_size, gint *pos, gint *frac)
+{
+  gint64 p = (((gint64) 2 * x + 1) * in_size - out_size) * WEIGHT_ONE / (2 * out_size);
+
+  p = CLAMP (p, 0, (gint64) (in_size - 1) * WEIGHT_ONE);
+  *pos = (gint) (p >> WEIGHT_BITS);
+  *frac = (gint) (p & (WEIGHT_ONE - 1));
+}
+
+/* Widens @in_rect to every output pixel whose bilinear footprint it
+ * touches. Subsampled formats are aligned to 2x2 blocks. */
+void
+gst_cef_scale_damage_rect (const GstVideoInfo *in_info, const GstVideoInfo *out_info,
+    const GstVideoRectangle *in_rect, GstVideoRectangle *out_rect)
+{
+  gint in_w = GST_VIDEO_INFO_WIDTH (in_info), in_h = GST_VIDEO_INFO_HEIGHT (in_info);
+  gint out_w = GST_VIDEO_INFO_WIDTH (out_info), out_h = GST_VIDEO_INFO_HEIGHT (out_info);
+  gint64 x0, y0, x1, y1;
+
+  /* Chroma of subsampled input spreads one more luma pixel around */
+  x0 = ((gint64) in_rect->x - 2) * out_w / in_w - 1;
+  y0 = ((gint64) in_rect->y - 2) * out_h / in_h - 1;
+  x1 = (((gint64) in_rect->x + in_rect->w + 2) * out_w + in_w - 1) / in_w + 1;
+  y1 = (((gint64) in_rect->y + in_rect->h + 2) * out_h + in_h - 1) / in_h + 1;
+
+  out_rect->x = (gint) CLAMP (x0, 0, out_w);
+  out_rect->y = (gint) CLAMP (y0, 0, out_h);
+  out_rect->w = (gint) CLAMP (x1, 0, out_w) - out_rect->x;
+  out_rect->h = (gint) CLAMP (y1, 0, out_h) - out_rect->y;
+
+  gst_cef_convert_align_rect (out_info, out_rect);
+}
+
+/* Source span averaged into output position @x when shrinking by more
+ * than 2x, where 2 taps would skip source pixels and alias */
+static void
+map_span (gint x, gint in_size, gint out_size, gint *pos, gint *count)
+{
+  gint start = (gint) ((gint64) x * in_size / out_size);
+  gint end = (gint) ((gint64) (x + 1) * in_size / out_size);
+
+  start = MIN (start, in_size - 1);
+  *pos = start;
+  *count = CLAMP (end - start, 1, in_size - start);
+}
+
+/* Same output scale as scale_row_h(), @counts pixels averaged from each
+ * offset */
+static void
+box_row_h (const guint8 *src, gint16 *dst, const gint *offsets, const gint *counts,
+    gint n, gint pixel_size)
+{
+  gint i, c, k;
+
+  for (i = 0; i < n; i++) {
+    const guint8 *a = src + offsets[i];
+    gint count = counts[i];
+
+    for (c = 0; c < pixel_size; c++) {
+      gint sum = 0;
+
+      for (k = 0; k < count; k++)
+        sum += a[k * pixel_size + c];
+      *dst++ = (gint16) ((sum * WEIGHT_ONE + count / 2) / count);
+    }
+  }
+}
+
+static void
+scale_row_h (const guint8 *src, gint16 *dst, const gint *offsets, const gint *fracs,
+    gint n, gint pixel_size, gint last)
+{
+  gint i, c;
+
+  for (i = 0; i < n; i++) {
+    const guint8 *a = src + offsets[i];
+    const guint8 *b = offsets[i] < last ? a + pixel_size : a;
+    gint f = fracs[i];
+
+    for (c = 0; c < pixel_size; c++)
+      *dst++ = (gint16) (a[c] * (WEIGHT_ONE - f) + b[c] * f);
+  }
+}
+
+static void
+blend_rows_v_scalar (const gint16 *a, const gint16 *b, guint8 *dst, gint n, gint f)
+{
+  gint i;
+
+  for (i = 0; i < n; i++)
+    dst[i] = (guint8) CLAMP ((a[i] * (WEIGHT_ONE - f) + b[i] * f + VROUND) >> VSHIFT, 0, 255);
+}
+
+#if defined(GST_CEF_SCALE_SSE2)
+
+static void
+blend_rows_v (const gint16 *a, const gint16 *b, guint8 *dst, gint n, gint f)
+{
+  const __m128i w = _mm_set1_epi32 ((f << 16) | (WEIGHT_ONE - f));
+  const __m128i round = _mm_set1_epi32 (VROUND);
+  gint i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m128i va = _mm_loadu_si128 ((const __m128i *) (a + i));
+    __m128i vb = _mm_loadu_si128 ((const __m128i *) (b + i));
+    __m128i lo = _mm_madd_epi16 (_mm_unpacklo_epi16 (va, vb), w);
+    __m128i hi = _mm_madd_epi16 (_mm_unpackhi_epi16 (va, vb), w);
+
+    lo = _mm_srai_epi32 (_mm_add_epi32 (lo, round), VSHIFT);
+    hi = _mm_srai_epi32 (_mm_add_epi32 (hi, round), VSHIFT);
+    lo = _mm_packs_epi32 (lo, hi);
+    _mm_storel_epi64 ((__m128i *) (dst + i), _mm_packus_epi16 (lo, lo));
+  }
+
+  blend_rows_v_scalar (a + i, b + i, dst + i, n - i, f);
+}
+
+#elif defined(GST_CEF_SCALE_NEON)
+
+static void
+blend_rows_v (const gint16 *a, const gint16 *b, guint8 *dst, gint n, gint f)
+{
+  const uint16x4_t wa = vdup_n_u16 (WEIGHT_ONE - f), wb = vdup_n_u16 (f);
+  gint i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    uint16x8_t va = vreinterpretq_u16_s16 (vld1q_s16 (a + i));
+    uint16x8_t vb = vreinterpretq_u16_s16 (vld1q_s16 (b + i));
+    uint32x4_t lo = vmlal_u16 (vmull_u16 (vget_low_u16 (va), wa), vget_low_u16 (vb), wb);
+    uint32x4_t hi = vmlal_u16 (vmull_u16 (vget_high_u16 (va), wa), vget_high_u16 (vb), wb);
+
+    vst1_u8 (dst + i, vqmovn_u16 (vcombine_u16 (vrshrn_n_u32 (lo, VSHIFT),
+        vrshrn_n_u32 (hi, VSHIFT))));
+  }
+
+  blend_rows_v_scalar (a + i, b + i, dst + i, n - i, f);
+}
+
+#else
+
+#define blend_rows_v blend_rows_v_scalar
+
+#endif
+
+typedef struct {
+  const GstVideoFrame *src;
+  GstVideoFrame *dst;
+  const GstVideoRectangle *rect;
+} ScaleJob;
+
+static void
+scale_plane_stripe (const ScaleJob *job, guint plane, const PlaneLayout *layout,
+    guint stripe, guint n_stripes)
+{
+  const GstVideoRectangle *rect = job->rect;
+  gint sub = layout->sub, ps = layout->pixel_size;
+  gint in_w = (GST_VIDEO_FRAME_WIDTH (job->src) + sub) >> sub;
+  gint in_h = (GST_VIDEO_FRAME_HEIGHT (job->src) + sub) >> sub;
+  gint out_w = (GST_VIDEO_FRAME_WIDTH (job->dst) + sub) >> sub;
+  gint out_h = (GST_VIDEO_FRAME_HEIGHT (job->dst) + sub) >> sub;
+  gint x0 = rect->x >> sub, y0 = rect->y >> sub;
+  gint w = MIN (((rect->x + rect->w + sub) >> sub), out_w) - x0;
+  gint h = MIN (((rect->y + rect->h + sub) >> sub), out_h) - y0;
+  gint ys = y0 + h * stripe / n_stripes, ye = y0 + h * (stripe + 1) / n_stripes;
+  const guint8 *src = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (job->src, plane);
+  gint src_stride = GST_VIDEO_FRAME_PLANE_STRIDE (job->src, plane);
+  guint8 *dst = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (job->dst, plane);
+  gint dst_stride = GST_VIDEO_FRAME_PLANE_STRIDE (job->dst, plane);
+  gint last = (in_w - 1) * ps;
+  gboolean box_x = in_w > 2 * out_w, box_y = in_h > 2 * out_h;
+  gint *offsets, *fracs;
+  gint16 *row_data, *rows[2];
+  gint row_y[2] = { -1, -1 };
+  gint x, y, n = w * ps;
+
+  if (w <= 0 || ye <= ys)
+    return;
+
+  /* fracs holds span lengths when box filtering */
+  offsets = g_new (gint, w * 2);
+  fracs = offsets + w;
+  row_data = g_new (gint16, n * 2);
+  rows[0] = row_data;
+  rows[1] = row_data + n;
+
+  for (x = 0; x < w; x++) {
+    if (box_x)
+      map_span (x0 + x, in_w, out_w, &offsets[x], &fracs[x]);
+    else
+      map_position (x0 + x, in_w, out_w, &offsets[x], &fracs[x]);
+    offsets[x] *= ps;
+  }
+
+#define FILTER_ROW(sy, out) G_STMT_START { \
+    const guint8 *row = src + (gsize) (sy) * src_stride; \
+    if (box_x) \
+      box_row_h (row, out, offsets, fracs, w, ps); \
+    else \
+      scale_row_h (row, out, offsets, fracs, w, ps, last); \
+  } G_STMT_END
+
+  if (box_y) {
+    gint *acc = g_new (gint, n);
+
+    for (y = ys; y < ye; y++) {
+      gint sy, count, k, i, div;
+
+      map_span (y, in_h, out_h, &sy, &count);
+      memset (acc, 0, n * sizeof (gint));
+      for (k = 0; k < count; k++) {
+        FILTER_ROW (sy + k, rows[0]);
+        for (i = 0; i < n; i++)
+          acc[i] += rows[0][i];
+      }
+
+      div = count * WEIGHT_ONE;
+      for (i = 0; i < n; i++)
+        dst[(gsize) y * dst_stride + x0 * ps + i] =
+            (guint8) CLAMP ((acc[i] + div / 2) / div, 0, 255);
+    }
+
+    g_free (acc);
+    goto done;
+  }
+
+  for (y = ys; y < ye; y++) {
+    gint sy, fy, sy1;
+
+    map_position (y, in_h, out_h, &sy, &fy);
+    sy1 = MIN (sy + 1, in_h - 1);
+
+    /* Consecutive output rows mostly share their source rows */
+    if (row_y[0] != sy && row_y[1] == sy) {
+      gint16 *tmp = rows[0];
+
+      rows[0] = rows[1];
+      rows[1] = tmp;
+      row_y[1] = row_y[0];
+      row_y[0] = sy;
+    }
+
+    if (row_y[0] != sy) {
+      FILTER_ROW (sy, rows[0]);
+      row_y[0] = sy;
+    }
+
+    if (row_y[1] != sy1) {
+      FILTER_ROW (sy1, rows[1]);
+      row_y[1] = sy1;
+    }
+
+    blend_rows_v (rows[0], rows[1], dst + (gsize) y * dst_stride + x0 * ps, n, fy);
+  }
+
+#undef FILTER_ROW
+
+done:
+  g_free (row_data);
+  g_free (offsets);
+}
+
+static void
+scale_stripe (guint stripe, guint n_stripes, ScaleJob *job)
+{
+  PlaneLayout planes[3];
+  guint i, n_planes;
+
+  n_planes = get_planes (GST_VIDEO_FRAME_FORMAT (job->dst), planes);
+  for (i = 0; i < n_planes; i++)
+    scale_plane_stripe (job, i, &planes[i], stripe, n_stripes);
+}
+
+/* Bilinearly scales the part of @src that lands in @rect of @dst, area
+ * averaging along axes shrunk by more than 2x. Both
+ * frames must have the same format, @rect must have gone through
+ * gst_cef_convert_align_rect(). Large rectangles are split into stripes
+ * of rows over @pool when given. */
+void
+gst_cef_scale_rect (const GstVideoFrame *src, GstVideoFrame *dst,
+    const GstVideoRectangle *rect, GstCefStripePool *pool)
+{
+  ScaleJob job = { src, dst, rect };
+  guint n_stripes = 1;
+
+  if (rect->w <= 0 || rect->h <= 0)
+    return;
+
+  if (pool && rect->w * rect->h >= STRIPE_MIN_PIXELS) {
+    n_stripes = MIN (gst_cef_stripe_pool_get_n_threads (pool),
+        (guint) (rect->w * rect->h / (STRIPE_MIN_PIXELS / 4)));
+    n_stripes = MIN (n_stripes, (guint) (rect->h + 1) / 2);
+  }
+
+  if (n_stripes > 1)
+    gst_cef_stripe_pool_run (pool, n_stripes, (GstCefStripeFunc) scale_stripe, &job);
+  else
+    scale_stripe (0, 1, &job);
+}
@@ -0,0 +1,19 @@
+#ifndef __GST_CEF_SCALE_H__
+#define __GST_CEF_SCALE_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "gstcefstripepool.h"
+
+G_BEGIN_DECLS
+
+void gst_cef_scale_damage_rect (const GstVideoInfo *in_info, const GstVideoInfo *out_info,
+    const GstVideoRectangle *in_rect, GstVideoRectangle *out_rect);
+
+void gst_cef_scale_rect (const GstVideoFrame *src, GstVideoFrame *dst,
+    const GstVideoRectangle *rect, GstCefStripePool *pool);
+
+G_END_DECLS
+
+#endif /* __GST_CEF_SCALE_H__ */
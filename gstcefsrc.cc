@@ -16,9 +16,19 @@
 #include <include/base/cef_callback_helpers.h>
 #include <include/wrapper/cef_closure_task.h>
 #include <include/wrapper/cef_message_router.h>
+#include <include/cef_devtools_message_observer.h>
+#include <include/cef_values.h>
 
 #include "gstcefsrc.h"
 #include "gstcefaudiometa.h"
+#include "gstcefinterleave.h"
+#include "gstcefconvert.h"
+#include "gstcefstripepool.h"
+/* GstShmAllocator is only public since 1.24 */
+#if defined(G_OS_UNIX) && GST_CHECK_VERSION(1, 24, 0)
+#define GST_CEF_SRC_HAVE_FD_MEMORY 1
+#include <gst/allocators/allocators.h>
+#endif
 #ifdef __APPLE__
 #include "gstcefloader.h"
 #include "gstcefnsapplication.h"
@@ -53,6 +63,19 @@ GST_DEBUG_CATEGORY_STATIC (cef_console_debug);
 #define DEFAULT_SANDBOX FALSE
 #endif
 #define DEFAULT_LISTEN_FOR_JS_SIGNALS FALSE
+#define DEFAULT_DUPLICATE_MODE CEF_SRC_DUPLICATE_MODE_NONE
+#define DEFAULT_VARIABLE_FRAMERATE FALSE
+#define DEFAULT_AUDIO_MODE CEF_SRC_AUDIO_MODE_FRAME
+#define DEFAULT_AUDIO_QUEUE_SIZE 256
+#define DEFAULT_AUDIO_OVERFLOW GST_CEF_AUDIO_QUEUE_DROP_OLDEST
+#define DEFAULT_MIN_FPS_N 1
+#define DEFAULT_MIN_FPS_D 1
+#define DEFAULT_IS_LIVE TRUE
+#define DEFAULT_FD_MEMORY FALSE
+#define DEFAULT_STATS_INTERVAL 0
+
+/* How long a non-live cefsrc waits for a paint it requested */
+#define CEF_SRC_BEGIN_FRAME_TIMEOUT (5 * G_TIME_SPAN_SECOND)
 
 using CefStatus = enum : guint8 {
   // CEF was either unloaded successfully or not yet loaded.
@@ -104,6 +127,65 @@ gst_cef_log_severity_mode_get_type (void)
   return type;
 }
 
+#define GST_TYPE_CEF_DUPLICATE_MODE \
+  (gst_cef_duplicate_mode_get_type ())
+
+static const GEnumValue duplicate_mode_values[] = {
+  {CEF_SRC_DUPLICATE_MODE_NONE, "Output repeated frames as is", "none"},
+  {CEF_SRC_DUPLICATE_MODE_FLAG, "Flag repeated frames GAP and DROPPABLE", "flag"},
+  {CEF_SRC_DUPLICATE_MODE_GAP, "Send GAP events instead of repeated frames", "gap"},
+  {0, NULL, NULL},
+};
+
+static GType
+gst_cef_duplicate_mode_get_type (void)
+{
+  static GType type = 0;
+  if (!type) {
+    type = g_enum_register_static ("GstCefDuplicateMode", duplicate_mode_values);
+  }
+  return type;
+}
+
+#define GST_TYPE_CEF_AUDIO_MODE \
+  (gst_cef_audio_mode_get_type ())
+
+static const GEnumValue audio_mode_values[] = {
+  {CEF_SRC_AUDIO_MODE_FRAME, "Attach audio to the next video frame", "frame"},
+  {CEF_SRC_AUDIO_MODE_IMMEDIATE, "Send audio out between video frames as soon as it comes in", "immediate"},
+  {0, NULL, NULL},
+};
+
+static GType
+gst_cef_audio_mode_get_type (void)
+{
+  static GType type = 0;
+  if (!type) {
+    type = g_enum_register_static ("GstCefAudioMode", audio_mode_values);
+  }
+  return type;
+}
+
+#define GST_TYPE_CEF_AUDIO_OVERFLOW \
+  (gst_cef_audio_overflow_get_type ())
+
+static const GEnumValue audio_overflow_values[] = {
+  {GST_CEF_AUDIO_QUEUE_DROP_OLDEST, "Drop the oldest queued audio", "drop-oldest"},
+  {GST_CEF_AUDIO_QUEUE_DROP_NEWEST, "Drop incoming audio", "drop-newest"},
+  {GST_CEF_AUDIO_QUEUE_BLOCK, "Block the CEF audio thread until there is room", "block"},
+  {0, NULL, NULL},
+};
+
+static GType
+gst_cef_audio_overflow_get_type (void)
+{
+  static GType type = 0;
+  if (!type) {
+    type = g_enum_register_static ("GstCefAudioOverflow", audio_overflow_values);
+  }
+  return type;
+}
+
 static gint gst_cef_log_severity_from_str (const gchar *str)
 {
   for (guint i = 0; i < sizeof(log_severity_values) / sizeof(GEnumValue); i++) {
@@ -129,12 +211,23 @@ enum
   PROP_JS_FLAGS,
   PROP_LOG_SEVERITY,
   PROP_CEF_CACHE_LOCATION,
+  PROP_DUPLICATE_MODE,
+  PROP_VARIABLE_FRAMERATE,
+  PROP_MIN_FRAMERATE,
+  PROP_IS_LIVE,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
+  PROP_AUDIO_MODE,
+  PROP_AUDIO_QUEUE_SIZE,
+  PROP_AUDIO_OVERFLOW,
+  PROP_FD_MEMORY,
+  PROP_HELPER_SETTINGS_ENV,
 };
 
 #define gst_cef_src_parent_class parent_class
 G_DEFINE_TYPE (GstCefSrc, gst_cef_src, GST_TYPE_PUSH_SRC);
 
-#define CEF_VIDEO_CAPS "video/x-raw, format=BGRA, width=[1, 2147483647], height=[1, 2147483647], framerate=[1/1, 60/1], pixel-aspect-ratio=1/1"
+#define CEF_VIDEO_CAPS "video/x-raw, format={ BGRA, I420, NV12, Y444 }, width=[1, 2147483647], height=[1, 2147483647], framerate=[0/1, 240/1], pixel-aspect-ratio=1/1"
 #define CEF_AUDIO_CAPS "audio/x-raw, format=F32LE, rate=[1, 2147483647], channels=[1, 2147483647], layout=interleaved"
 
 static GstStaticPadTemplate gst_cef_src_template =
@@ -152,6 +245,473 @@ gchar* get_plugin_base_path () {
 }
 
 
+/** Paint helpers */
+
+static void
+gst_cef_damage_clear (GstCefDamage *damage)
+{
+  damage->n_rects = 0;
+}
+
+static void
+gst_cef_damage_add_full (GstCefDamage *damage, gint width, gint height)
+{
+  damage->rects[0].x = 0;
+  damage->rects[0].y = 0;
+  damage->rects[0].w = width;
+  damage->rects[0].h = height;
+  damage->n_rects = 1;
+}
+
+static gboolean
+gst_cef_rect_contains (const GstVideoRectangle *outer, const GstVideoRectangle *inner)
+{
+  return inner->x >= outer->x && inner->y >= outer->y &&
+      inner->x + inner->w <= outer->x + outer->w &&
+      inner->y + inner->h <= outer->y + outer->h;
+}
+
+/* Clips @rect to the frame and appends it, collapsing everything into
+ * the bounding box once CEF_SRC_MAX_DAMAGE_RECTS is exceeded */
+static void
+gst_cef_damage_add (GstCefDamage *damage, const GstVideoRectangle *rect,
+    gint width, gint height)
+{
+  GstVideoRectangle r;
+  gint x0, y0, x1, y1;
+  guint i;
+
+  x0 = CLAMP (rect->x, 0, width);
+  y0 = CLAMP (rect->y, 0, height);
+  x1 = CLAMP (rect->x + rect->w, 0, width);
+  y1 = CLAMP (rect->y + rect->h, 0, height);
+
+  if (x1 <= x0 || y1 <= y0)
+    return;
+
+  r.x = x0;
+  r.y = y0;
+  r.w = x1 - x0;
+  r.h = y1 - y0;
+
+  for (i = 0; i < damage->n_rects; i++) {
+    if (gst_cef_rect_contains (&damage->rects[i], &r))
+      return;
+  }
+
+  if (damage->n_rects < CEF_SRC_MAX_DAMAGE_RECTS) {
+    damage->rects[damage->n_rects++] = r;
+    return;
+  }
+
+  for (i = 0; i < damage->n_rects; i++) {
+    x0 = MIN (x0, damage->rects[i].x);
+    y0 = MIN (y0, damage->rects[i].y);
+    x1 = MAX (x1, damage->rects[i].x + damage->rects[i].w);
+    y1 = MAX (y1, damage->rects[i].y + damage->rects[i].h);
+  }
+
+  damage->rects[0].x = x0;
+  damage->rects[0].y = y0;
+  damage->rects[0].w = x1 - x0;
+  damage->rects[0].h = y1 - y0;
+  damage->n_rects = 1;
+}
+
+static void
+gst_cef_damage_union (GstCefDamage *damage, const GstCefDamage *other,
+    gint width, gint height)
+{
+  guint i;
+
+  for (i = 0; i < other->n_rects; i++)
+    gst_cef_damage_add (damage, &other->rects[i], width, height);
+}
+
+static gboolean
+gst_cef_rect_intersect (const GstVideoRectangle *a, const GstVideoRectangle *b,
+    GstVideoRectangle *out)
+{
+  gint x0 = MAX (a->x, b->x);
+  gint y0 = MAX (a->y, b->y);
+  gint x1 = MIN (a->x + a->w, b->x + b->w);
+  gint y1 = MIN (a->y + a->h, b->y + b->h);
+
+  if (x1 <= x0 || y1 <= y0)
+    return FALSE;
+
+  out->x = x0;
+  out->y = y0;
+  out->w = x1 - x0;
+  out->h = y1 - y0;
+
+  return TRUE;
+}
+
+static void
+gst_cef_copy_rect (guint8 *dst, gint dst_stride, const guint8 *src,
+    gint src_stride, const GstVideoRectangle *rect)
+{
+  gsize offset_dst = (gsize) rect->y * dst_stride + rect->x * 4;
+  gsize offset_src = (gsize) rect->y * src_stride + rect->x * 4;
+  gint i;
+
+  if (dst_stride == src_stride && rect->w * 4 == dst_stride) {
+    memcpy (dst + offset_dst, src + offset_src, (gsize) rect->h * dst_stride);
+    return;
+  }
+
+  for (i = 0; i < rect->h; i++) {
+    memcpy (dst + offset_dst, src + offset_src, rect->w * 4);
+    offset_dst += dst_stride;
+    offset_src += src_stride;
+  }
+}
+
+static guint64
+gst_cef_damage_area (const GstCefDamage *damage)
+{
+  guint64 area = 0;
+  guint i;
+
+  for (i = 0; i < damage->n_rects; i++)
+    area += (guint64) damage->rects[i].w * damage->rects[i].h;
+
+  return area;
+}
+
+typedef struct {
+  guint8 *dst;
+  gint dst_stride;
+  const guint8 *src;
+  gint src_stride;
+  const GstCefDamage *damage;
+} GstCefCopyJob;
+
+/* Every stripe copies its share of the rows of every rectangle */
+static void
+gst_cef_copy_stripe (guint stripe, guint n_stripes, GstCefCopyJob *job)
+{
+  guint i;
+
+  for (i = 0; i < job->damage->n_rects; i++) {
+    GstVideoRectangle r = job->damage->rects[i];
+    gint y0 = r.y + r.h * stripe / n_stripes;
+    gint y1 = r.y + r.h * (stripe + 1) / n_stripes;
+
+    r.y = y0;
+    r.h = y1 - y0;
+    if (r.h > 0)
+      gst_cef_copy_rect (job->dst, job->dst_stride, job->src, job->src_stride, &r);
+  }
+}
+
+/* Large copies are spread over the stripe workers, so the CEF UI thread,
+ * shared by every cefsrc in the process, gets back to handling input and
+ * other browsers sooner. It still takes a stripe itself and waits for the
+ * others, both here and when publishing, so a paint only returns once the
+ * frame is fully converted */
+static void
+gst_cef_copy_damage (guint8 *dst, gint dst_stride, const guint8 *src,
+    gint src_stride, const GstCefDamage *damage)
+{
+  GstCefCopyJob job = { dst, dst_stride, src, src_stride, damage };
+  GstCefStripePool *pool;
+  guint64 area = gst_cef_damage_area (damage);
+  guint n_stripes;
+
+  if (area < CEF_SRC_COPY_STRIPE_MIN_PIXELS) {
+    gst_cef_copy_stripe (0, 1, &job);
+    return;
+  }
+
+  pool = gst_cef_stripe_pool_get_default ();
+  n_stripes = (guint) MIN (gst_cef_stripe_pool_get_n_threads (pool),
+      area / CEF_SRC_COPY_STRIPE_MIN_PIXELS);
+  gst_cef_stripe_pool_run (pool, n_stripes, (GstCefStripeFunc) gst_cef_copy_stripe, &job);
+}
+
+/* Every statistic has a single writer, a plain load and store is enough
+ * and readers only need a recent value */
+static inline void
+gst_cef_src_stat_add (std::atomic<guint64> &stat, guint64 value)
+{
+  stat.store (stat.load (std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static inline guint64
+gst_cef_src_stat_get (const std::atomic<guint64> &stat)
+{
+  return stat.load (std::memory_order_relaxed);
+}
+
+/* Copies @damage from CEF's paint buffer. Both it and back_buffer are
+ * tightly packed BGRA, whatever the output format is. */
+static void
+gst_cef_src_update_back_buffer (GstCefSrc *src, const GstCefDamage *damage,
+    const guint8 *data)
+{
+  GstMapInfo info;
+  gint stride = src->paint_vinfo.width * 4;
+
+  gst_buffer_map (src->back_buffer, &info, GST_MAP_WRITE);
+  gst_cef_copy_damage (info.data, stride, data, stride, damage);
+  gst_buffer_unmap (src->back_buffer, &info);
+
+  gst_cef_src_stat_add (src->bytes_copied, gst_cef_damage_area (damage) * 4);
+}
+
+static gboolean
+gst_cef_src_copy_damage (GstCefSrc *src, GstBuffer *dst, GstBuffer *back,
+    const GstCefDamage *damage)
+{
+  GstVideoFrame frame;
+  GstMapInfo back_info;
+  gint back_stride = src->paint_vinfo.width * 4;
+  guint i;
+
+  if (!damage->n_rects)
+    return TRUE;
+
+  /* Frames from the pool may carry a GstVideoMeta with a padded stride */
+  if (!gst_video_frame_map (&frame, &src->paint_vinfo, dst, GST_MAP_WRITE))
+    return FALSE;
+
+  gst_cef_src_stat_add (src->bytes_copied, gst_cef_damage_area (damage) * 4);
+
+  gst_buffer_map (back, &back_info, GST_MAP_READ);
+  if (GST_VIDEO_INFO_FORMAT (&src->paint_vinfo) == GST_VIDEO_FORMAT_BGRA) {
+    gst_cef_copy_damage ((guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&frame, 0),
+        GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0), back_info.data, back_stride, damage);
+  } else {
+    /* Only what changed gets converted again, the rest of the frame
+     * already holds up to date YUV */
+    for (i = 0; i < damage->n_rects; i++) {
+      GstVideoRectangle rect = damage->rects[i];
+
+      gst_cef_convert_align_rect (&src->paint_vinfo, &rect);
+      gst_cef_convert_rect (&src->paint_matrix, back_info.data, back_stride,
+          &frame, &rect, gst_cef_stripe_pool_get_default ());
+    }
+  }
+  gst_buffer_unmap (back, &back_info);
+  gst_video_frame_unmap (&frame);
+
+  return TRUE;
+}
+
+static void
+gst_cef_src_clear_popup (GstCefSrc *src)
+{
+  g_clear_pointer (&src->popup_pixels, g_free);
+  g_clear_pointer (&src->popup_under, g_free);
+}
+
+/* Blends the popup over the view pixels it covers, within @rect, into
+ * back_buffer. CEF hands out premultiplied BGRA. */
+static void
+gst_cef_src_compose_popup (GstCefSrc *src, guint8 *back, const GstVideoRectangle *rect)
+{
+  const GstVideoRectangle *clip = &src->popup_clip, *popup = &src->popup_rect;
+  gint stride = src->paint_vinfo.width * 4;
+  gint x, y, c;
+
+  for (y = rect->y; y < rect->y + rect->h; y++) {
+    const guint8 *p = src->popup_pixels + ((y - popup->y) * popup->w + rect->x - popup->x) * 4;
+    const guint8 *u = src->popup_under + ((y - clip->y) * clip->w + rect->x - clip->x) * 4;
+    guint8 *d = back + y * stride + rect->x * 4;
+
+    for (x = 0; x < rect->w; x++, p += 4, u += 4, d += 4) {
+      guint inv = 255 - p[3];
+
+      if (inv == 0) {
+        memcpy (d, p, 4);
+      } else {
+        for (c = 0; c < 4; c++) {
+          guint t = u[c] * inv + 128;
+
+          d[c] = MIN (p[c] + ((t + (t >> 8)) >> 8), 255);
+        }
+      }
+    }
+  }
+}
+
+/* Keeps popup_under in sync with view paints and composes the popup
+ * back over the parts of @damage it covers */
+static void
+gst_cef_src_update_popup_under (GstCefSrc *src, const GstCefDamage *damage,
+    const guint8 *data)
+{
+  GstMapInfo info;
+  gint stride = src->paint_vinfo.width * 4;
+  guint i;
+
+  if (!src->popup_under)
+    return;
+
+  gst_buffer_map (src->back_buffer, &info, GST_MAP_WRITE);
+  for (i = 0; i < damage->n_rects; i++) {
+    GstVideoRectangle r, local;
+
+    if (!gst_cef_rect_intersect (&damage->rects[i], &src->popup_clip, &r))
+      continue;
+
+    local.x = 0;
+    local.y = 0;
+    local.w = r.w;
+    local.h = r.h;
+    gst_cef_copy_rect (src->popup_under + ((r.y - src->popup_clip.y) * src->popup_clip.w +
+        r.x - src->popup_clip.x) * 4, src->popup_clip.w * 4,
+        data + r.y * stride + r.x * 4, stride, &local);
+    gst_cef_src_compose_popup (src, info.data, &r);
+  }
+  gst_buffer_unmap (src->back_buffer, &info);
+}
+
+/* Puts the view pixels the popup covered back into back_buffer */
+static void
+gst_cef_src_hide_popup (GstCefSrc *src, GstCefDamage *damage)
+{
+  GstMapInfo info;
+  const GstVideoRectangle *clip = &src->popup_clip;
+  GstVideoRectangle local = { 0, 0, clip->w, clip->h };
+  gint stride = src->paint_vinfo.width * 4;
+
+  if (!src->popup_under)
+    return;
+
+  gst_buffer_map (src->back_buffer, &info, GST_MAP_WRITE);
+  gst_cef_copy_rect (info.data + clip->y * stride + clip->x * 4, stride,
+      src->popup_under, clip->w * 4, &local);
+  gst_buffer_unmap (src->back_buffer, &info);
+
+  gst_cef_damage_add (damage, clip, src->paint_vinfo.width, src->paint_vinfo.height);
+  gst_cef_src_clear_popup (src);
+}
+
+/* A frame can be written to again once we hold the only reference to it
+ * and no copy pushed downstream shares its memory anymore. Only the UI
+ * thread hands out new references to frames, through current_buffer,
+ * and the streaming thread shares a frame's memory before it drops the
+ * reference it took from there, so this check cannot race with it. */
+static gboolean
+gst_cef_src_frame_is_free (GstBuffer *frame)
+{
+  return gst_buffer_is_writable (frame) && gst_buffer_is_all_memory_writable (frame);
+}
+
+static GstBuffer *
+gst_cef_src_acquire_frame (GstCefSrc *src, guint *idx)
+{
+  guint i;
+
+  for (i = 0; i < CEF_SRC_N_FRAMES; i++) {
+    if (src->frames[i] && gst_cef_src_frame_is_free (src->frames[i])) {
+      *idx = i;
+      return src->frames[i];
+    }
+  }
+
+  for (i = 0; i < CEF_SRC_N_FRAMES; i++) {
+    if (!src->frames[i])
+      break;
+  }
+
+  /* Every frame is still in use downstream, let it keep the one we
+   * replace and start over with a fresh allocation */
+  if (i == CEF_SRC_N_FRAMES) {
+    i = src->next_frame;
+    src->next_frame = (src->next_frame + 1) % CEF_SRC_N_FRAMES;
+    GST_LOG_OBJECT (src, "All frames busy, allocating a new one");
+    gst_buffer_unref (src->frames[i]);
+    gst_cef_src_stat_add (src->n_frames_busy, 1);
+  }
+
+  src->frames[i] = NULL;
+
+  /* Never block the UI thread on downstream returning buffers to the
+   * pool, a plain allocation with the default layout will do */
+  if (src->paint_pool) {
+    GstBufferPoolAcquireParams params = { GST_FORMAT_UNDEFINED, 0, 0,
+      GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT, { NULL, } };
+    GstFlowReturn ret;
+
+    ret = gst_buffer_pool_acquire_buffer (src->paint_pool, &src->frames[i], &params);
+    if (ret == GST_FLOW_FLUSHING) {
+      /* The pool was deactivated, look for its replacement next time */
+      GST_LOG_OBJECT (src, "Pool is flushing");
+      src->paint_cookie = g_atomic_int_get (&src->caps_cookie) - 1;
+    } else if (ret != GST_FLOW_OK) {
+      GST_LOG_OBJECT (src, "No buffer available from the pool");
+    }
+  }
+
+  if (!src->frames[i])
+    src->frames[i] = gst_buffer_new_allocate (src->paint_allocator, src->paint_vinfo.size,
+        &src->paint_params);
+
+  gst_cef_damage_add_full (&src->frames_stale[i], src->paint_vinfo.width,
+      src->paint_vinfo.height);
+
+  *idx = i;
+  return src->frames[i];
+}
+
+/* Damage is attached to the frame itself, so it travels through
+ * current_buffer together with the pixels */
+static void
+gst_cef_src_set_frame_damage (GstBuffer *frame, GstCefDamage *damage)
+{
+  GstCefDamageMeta *dmeta = gst_buffer_get_cef_damage_meta (frame);
+
+  if (dmeta) {
+    memcpy (dmeta->rects, damage->rects, damage->n_rects * sizeof (GstVideoRectangle));
+    dmeta->n_rects = damage->n_rects;
+  } else {
+    gst_buffer_add_cef_damage_meta (frame, damage->rects, damage->n_rects);
+  }
+}
+
+static void
+gst_cef_src_release_frames (GstCefSrc *src)
+{
+  guint i;
+
+  for (i = 0; i < CEF_SRC_N_FRAMES; i++) {
+    gst_buffer_replace (&src->frames[i], NULL);
+    gst_cef_damage_clear (&src->frames_stale[i]);
+  }
+
+  gst_buffer_replace (&src->back_buffer, NULL);
+  gst_cef_src_clear_popup (src);
+  gst_clear_object (&src->paint_pool);
+  gst_clear_object (&src->paint_allocator);
+  src->next_frame = 0;
+}
+
+/* Lock-free swap of current_buffer, returns the previous value */
+static GstBuffer *
+gst_cef_src_exchange_current_buffer (GstCefSrc *src, GstBuffer *buffer)
+{
+  GstBuffer *old;
+
+  do {
+    old = (GstBuffer *) g_atomic_pointer_get (&src->current_buffer);
+  } while (!g_atomic_pointer_compare_and_exchange (&src->current_buffer, old, buffer));
+
+  return old;
+}
+
+static void
+gst_cef_src_clear_current_buffer (GstCefSrc *src)
+{
+  GstBuffer *old = gst_cef_src_exchange_current_buffer (src, NULL);
+
+  if (old)
+    gst_buffer_unref (old);
+}
+
 /** Cef Client */
 
 /** Handlers */
@@ -227,6 +787,95 @@ class MessageHandler : public CefMessageRouterBrowserSide::Handler {
   DISALLOW_COPY_AND_ASSIGN(MessageHandler);
 };
 
+/* Picks up new caps and their pool from the streaming thread, the
+ * object lock is only taken when caps_cookie says something changed */
+static void
+gst_cef_src_sync_paint_info (GstCefSrc *src)
+{
+  gint cookie = g_atomic_int_get (&src->caps_cookie);
+
+  if (cookie != src->paint_cookie) {
+    GstBufferPool *pool;
+
+    GST_OBJECT_LOCK (src);
+    pool = src->alloc_pool ? (GstBufferPool *) gst_object_ref (src->alloc_pool) : NULL;
+    if (!gst_video_info_is_equal (&src->alloc_vinfo, &src->paint_vinfo) || pool != src->paint_pool) {
+      gst_cef_src_release_frames (src);
+      src->paint_vinfo = src->alloc_vinfo;
+      gst_cef_convert_matrix_init (&src->paint_matrix, &src->paint_vinfo);
+      if (pool) {
+        GstStructure *config = gst_buffer_pool_get_config (pool);
+        GstAllocator *allocator = NULL;
+
+        gst_buffer_pool_config_get_allocator (config, &allocator, &src->paint_params);
+        gst_object_replace ((GstObject **) &src->paint_allocator, (GstObject *) allocator);
+        gst_structure_free (config);
+      }
+      src->paint_pool = pool;
+      pool = NULL;
+    }
+    GST_OBJECT_UNLOCK (src);
+
+    gst_clear_object (&pool);
+    src->paint_cookie = cookie;
+  }
+}
+
+/* Brings a recycled frame up to date with back_buffer and hands it over
+ * to the streaming thread */
+static void
+gst_cef_src_publish_damage (GstCefSrc *src, const GstCefDamage *damage)
+{
+  gint w = src->paint_vinfo.width, h = src->paint_vinfo.height;
+  GstBuffer *frame, *old;
+  guint i;
+
+  if (!src->back_buffer)
+    return;
+
+  for (i = 0; i < CEF_SRC_N_FRAMES; i++)
+    gst_cef_damage_union (&src->frames_stale[i], damage, w, h);
+
+  frame = gst_cef_src_acquire_frame (src, &i);
+  if (!gst_cef_src_copy_damage (src, frame, src->back_buffer, &src->frames_stale[i])) {
+    /* Should not happen with the pool matching paint_vinfo, a plain
+     * allocation maps whatever its layout */
+    GST_WARNING_OBJECT (src, "Failed to map frame %" GST_PTR_FORMAT ", reallocating it", frame);
+    gst_buffer_unref (src->frames[i]);
+    src->frames[i] = frame = gst_buffer_new_allocate (src->paint_allocator,
+        src->paint_vinfo.size, &src->paint_params);
+    gst_cef_damage_add_full (&src->frames_stale[i], w, h);
+    if (!gst_cef_src_copy_damage (src, frame, src->back_buffer, &src->frames_stale[i])) {
+      gst_buffer_replace (&src->frames[i], NULL);
+      return;
+    }
+  }
+  gst_cef_damage_clear (&src->frames_stale[i]);
+
+  /* Report damage relative to the last frame create() took when that
+   * was our previous one, otherwise keep growing it: create() may
+   * then see more damage than needed, but never less */
+  if (g_atomic_int_get (&src->consumed_generation) == (gint) src->paint_generation)
+    src->published_damage = *damage;
+  else
+    gst_cef_damage_union (&src->published_damage, damage, w, h);
+  gst_cef_src_set_frame_damage (frame, &src->published_damage);
+
+  GST_BUFFER_OFFSET (frame) = ++src->paint_generation;
+  GST_BUFFER_PTS (frame) = g_get_monotonic_time () * GST_USECOND;
+  old = gst_cef_src_exchange_current_buffer (src, gst_buffer_ref (frame));
+  if (old)
+    gst_buffer_unref (old);
+  g_atomic_int_set (&src->latest_generation, (gint) src->paint_generation);
+
+  if (src->variable_framerate || !src->is_live) {
+    g_mutex_lock (&src->paint_lock);
+    g_cond_signal (&src->paint_cond);
+    g_mutex_unlock (&src->paint_lock);
+  }
+  gst_cef_src_stat_add (src->n_published, 1);
+}
+
 class RenderHandler : public CefRenderHandler
 {
   public:
@@ -248,19 +897,137 @@ class RenderHandler : public CefRenderHandler
       GST_OBJECT_UNLOCK (src);
     }
 
+    void OnPopupShow(CefRefPtr<CefBrowser> browser, bool show) override
+    {
+      GstCefDamage damage;
+
+      GST_LOG_OBJECT (src, "popup %s", show ? "shown" : "hidden");
+
+      if (show || !src->popup_pixels)
+        return;
+
+      gst_cef_damage_clear (&damage);
+      gst_cef_src_hide_popup (src, &damage);
+      gst_cef_src_publish_damage (src, &damage);
+    }
+
+    void OnPopupSize(CefRefPtr<CefBrowser> browser, const CefRect &rect) override
+    {
+      GstVideoRectangle view;
+      GstCefDamage damage;
+      GstMapInfo info;
+
+      GST_LOG_OBJECT (src, "popup rect %d,%d %dx%d", rect.x, rect.y, rect.width, rect.height);
+
+      /* Clip against the size we are about to paint at, not a stale one */
+      gst_cef_src_sync_paint_info (src);
+      view.x = 0;
+      view.y = 0;
+      view.w = src->paint_vinfo.width;
+      view.h = src->paint_vinfo.height;
+
+      /* Moving or resizing the popup uncovers what was under it */
+      gst_cef_damage_clear (&damage);
+      gst_cef_src_hide_popup (src, &damage);
+
+      src->popup_rect.x = rect.x;
+      src->popup_rect.y = rect.y;
+      src->popup_rect.w = rect.width;
+      src->popup_rect.h = rect.height;
+
+      if (src->back_buffer && rect.width > 0 && rect.height > 0 &&
+          gst_cef_rect_intersect (&src->popup_rect, &view, &src->popup_clip)) {
+        GstVideoRectangle local = { 0, 0, src->popup_clip.w, src->popup_clip.h };
+        gint stride = view.w * 4;
+
+        /* Transparent until CEF paints it */
+        src->popup_pixels = (guint8 *) g_malloc0 ((gsize) rect.width * rect.height * 4);
+        src->popup_under = (guint8 *) g_malloc ((gsize) src->popup_clip.w * src->popup_clip.h * 4);
+
+        gst_buffer_map (src->back_buffer, &info, GST_MAP_READ);
+        gst_cef_copy_rect (src->popup_under, src->popup_clip.w * 4,
+            info.data + src->popup_clip.y * stride + src->popup_clip.x * 4, stride, &local);
+        gst_buffer_unmap (src->back_buffer, &info);
+      }
+
+      if (damage.n_rects)
+        gst_cef_src_publish_damage (src, &damage);
+    }
+
     void OnPaint(CefRefPtr<CefBrowser> browser, PaintElementType type, const RectList &dirtyRects, const void * buffer, int w, int h) override
     {
-      GstBuffer *new_buffer;
+      GstCefDamage damage;
+      GstMapInfo info;
+      gint64 start = g_get_monotonic_time ();
+      GstClockTime duration;
 
       GST_LOG_OBJECT (src, "painting, width / height: %d %d", w, h);
 
-      new_buffer = gst_buffer_new_allocate (NULL, src->vinfo.width * src->vinfo.height * 4, NULL);
-      gst_buffer_fill (new_buffer, 0, buffer, w * h * 4);
+      gst_cef_src_stat_add (src->n_paints, 1);
 
-      GST_OBJECT_LOCK (src);
-      gst_buffer_replace (&(src->current_buffer), new_buffer);
-      gst_buffer_unref (new_buffer);
-      GST_OBJECT_UNLOCK (src);
+      gst_cef_src_sync_paint_info (src);
+
+      gst_cef_damage_clear (&damage);
+
+      if (type == PET_POPUP) {
+        if (!src->popup_pixels || w != src->popup_rect.w || h != src->popup_rect.h) {
+          GST_LOG_OBJECT (src, "Skipping popup paint without a matching popup rect");
+          return;
+        }
+
+        /* Popup dirty rects are relative to the popup itself, only copy
+         * those and compose them where they land in the view */
+        gst_buffer_map (src->back_buffer, &info, GST_MAP_WRITE);
+        for (const CefRect &rect : dirtyRects) {
+          GstVideoRectangle r = { rect.x, rect.y, rect.width, rect.height };
+          GstVideoRectangle popup = { 0, 0, w, h };
+
+          if (!gst_cef_rect_intersect (&r, &popup, &r))
+            continue;
+
+          gst_cef_copy_rect (src->popup_pixels, w * 4, (const guint8 *) buffer, w * 4, &r);
+
+          r.x += src->popup_rect.x;
+          r.y += src->popup_rect.y;
+          if (!gst_cef_rect_intersect (&r, &src->popup_clip, &r))
+            continue;
+
+          gst_cef_src_compose_popup (src, info.data, &r);
+          gst_cef_damage_add (&damage, &r, src->paint_vinfo.width, src->paint_vinfo.height);
+        }
+        gst_buffer_unmap (src->back_buffer, &info);
+      } else {
+        if (w != src->paint_vinfo.width || h != src->paint_vinfo.height) {
+          GST_LOG_OBJECT (src, "Skipping paint with stale dimensions");
+          return;
+        }
+
+        if (!src->back_buffer) {
+          src->back_buffer = gst_buffer_new_allocate (NULL, (gsize) w * h * 4, NULL);
+          gst_cef_damage_add_full (&damage, w, h);
+        } else {
+          for (const CefRect &rect : dirtyRects) {
+            GstVideoRectangle r = { rect.x, rect.y, rect.width, rect.height };
+            gst_cef_damage_add (&damage, &r, w, h);
+          }
+        }
+
+        gst_cef_src_update_back_buffer (src, &damage, (const guint8 *) buffer);
+        gst_cef_src_update_popup_under (src, &damage, (const guint8 *) buffer);
+
+        gst_cef_src_stat_add (src->dirty_pixels, gst_cef_damage_area (&damage));
+        gst_cef_src_stat_add (src->view_pixels, (guint64) w * h);
+      }
+
+      /* The conversion to the output frame runs here too, on the UI
+       * thread and the stripe workers it waits for */
+      if (damage.n_rects)
+        gst_cef_src_publish_damage (src, &damage);
+
+      duration = (g_get_monotonic_time () - start) * GST_USECOND;
+      gst_cef_src_stat_add (src->paint_duration, duration);
+      if (duration > gst_cef_src_stat_get (src->paint_duration_max))
+        src->paint_duration_max.store (duration, std::memory_order_relaxed);
 
       GST_LOG_OBJECT (src, "done painting");
     }
@@ -272,19 +1039,79 @@ class RenderHandler : public CefRenderHandler
     IMPLEMENT_REFCOUNTING(RenderHandler);
 };
 
-class AudioHandler : public CefAudioHandler
+static GstClockTime
+gst_cef_src_get_running_time (GstCefSrc *src)
 {
-  public:
+  GstClockTime base_time, now;
+  GstClock *clock;
 
-    AudioHandler(GstCefSrc *src) :
-        src (src)
+  GST_OBJECT_LOCK (src);
+  clock = GST_ELEMENT_CLOCK (src);
+  if (!clock) {
+    GST_OBJECT_UNLOCK (src);
+    return GST_CLOCK_TIME_NONE;
+  }
+  gst_object_ref (clock);
+  base_time = GST_ELEMENT_CAST (src)->base_time;
+  GST_OBJECT_UNLOCK (src);
+
+  now = gst_clock_get_time (clock);
+  gst_object_unref (clock);
+
+  return now > base_time ? now - base_time : 0;
+}
+
+class AudioHandler : public CefAudioHandler
+{
+  public:
+
+    AudioHandler(GstCefSrc *src) :
+        src (src)
     {
     }
 
     ~AudioHandler()
     {
+      ReleasePool();
+    }
+
+  bool GetAudioParameters(CefRefPtr<CefBrowser> browser,
+                          CefAudioParameters& params) override
+  {
+    /* Nothing to capture audio for */
+    if (!g_atomic_int_get (&src->audio_enabled)) {
+      GST_DEBUG_OBJECT (src, "Audio unused, not capturing it");
+      return false;
     }
 
+    GST_OBJECT_LOCK (src);
+    if (src->audio_rate)
+      params.sample_rate = src->audio_rate;
+    switch (src->audio_channels) {
+      case 1:
+        params.channel_layout = CEF_CHANNEL_LAYOUT_MONO;
+        break;
+      case 2:
+        params.channel_layout = CEF_CHANNEL_LAYOUT_STEREO;
+        break;
+      /* Same positions as the GStreamer fallback channel masks */
+      case 6:
+        params.channel_layout = CEF_CHANNEL_LAYOUT_5_1_BACK;
+        break;
+      case 8:
+        params.channel_layout = CEF_CHANNEL_LAYOUT_7_1;
+        break;
+      default:
+        break;
+    }
+    GST_OBJECT_UNLOCK (src);
+
+    GST_DEBUG_OBJECT (src, "Requesting audio at %d Hz, channel layout %d",
+        params.sample_rate, params.channel_layout);
+
+    return true;
+  }
+
   void OnAudioStreamStarted(CefRefPtr<CefBrowser> browser,
                             const CefAudioParameters& params,
                             int channels) override
@@ -297,9 +1124,10 @@ class AudioHandler : public CefAudioHandler
 
     mRate = params.sample_rate;
     mChannels = channels;
+    mMapped = FALSE;
 
     GST_OBJECT_LOCK (src);
-    src->audio_events = g_list_append (src->audio_events, event);
+    g_queue_push_tail (&src->audio_events, event);
     GST_OBJECT_UNLOCK (src);
   }
 
@@ -310,38 +1138,44 @@ class AudioHandler : public CefAudioHandler
   {
     GstBuffer *buf;
     GstMapInfo info;
-    gint i, j;
+
+    /* Downstream stopped consuming audio since the stream started */
+    if (!g_atomic_int_get (&src->audio_enabled))
+      return;
 
     GST_LOG_OBJECT (src, "Handling audio stream packet with %d frames", frames);
 
-    buf = gst_buffer_new_allocate (NULL, mChannels * frames * 4, NULL);
+    buf = AcquireBuffer (mChannels * frames * sizeof (gfloat));
 
     gst_buffer_map (buf, &info, GST_MAP_WRITE);
-    for (i = 0; i < mChannels; i++) {
-      gfloat *cdata = (gfloat *) data[i];
-
-      for (j = 0; j < frames; j++) {
-        memcpy (info.data + j * 4 * mChannels + i * 4, &cdata[j], 4);
-      }
-    }
+    gst_cef_interleave_f32 (data, (gfloat *) info.data, mChannels, frames);
     gst_buffer_unmap (buf, &info);
 
-    GST_OBJECT_LOCK (src);
-
     GST_BUFFER_DURATION (buf) = gst_util_uint64_scale (frames, GST_SECOND, mRate);
+    Timestamp (buf, pts * GST_MSECOND);
 
-    if (!src->audio_buffers) {
-      src->audio_buffers = gst_buffer_list_new();
-    }
+    gst_cef_audio_queue_push (src->audio_queue, buf,
+        (GstCefAudioQueueOverflow) g_atomic_int_get ((gint *) &src->audio_overflow));
 
-    gst_buffer_list_add (src->audio_buffers, buf);
-    GST_OBJECT_UNLOCK (src);
+    if (src->audio_mode == CEF_SRC_AUDIO_MODE_IMMEDIATE) {
+      g_mutex_lock (&src->paint_lock);
+      g_cond_signal (&src->paint_cond);
+      g_mutex_unlock (&src->paint_lock);
+    }
 
     GST_LOG_OBJECT (src, "Handled audio stream packet");
   }
 
   void OnAudioStreamStopped(CefRefPtr<CefBrowser> browser) override
   {
+    GstEvent *event = gst_event_new_custom (GST_EVENT_CUSTOM_DOWNSTREAM,
+        gst_structure_new_empty ("cef-audio-stream-stop"));
+
+    GST_OBJECT_LOCK (src);
+    g_queue_push_tail (&src->audio_events, event);
+    GST_OBJECT_UNLOCK (src);
+
+    ReleasePool();
   }
 
   void OnAudioStreamError(CefRefPtr<CefBrowser> browser,
@@ -351,9 +1185,96 @@ class AudioHandler : public CefAudioHandler
 
   private:
 
+    /* CEF timestamps packets against the wall clock. They get mapped to
+     * running time when the first one comes in, after that the mapping
+     * only follows the drift between both clocks: delivery jitter is
+     * smoothed out, the mapping is slewed by at most
+     * CEF_SRC_AUDIO_MAX_SLEW_PPM, and only reset when way off. */
+    void Timestamp(GstBuffer *buf, gint64 cef_pts)
+    {
+      GstClockTime now = gst_cef_src_get_running_time (src);
+      GstClockTime duration = GST_BUFFER_DURATION (buf);
+      gint64 error, pts;
+
+      if (!GST_CLOCK_TIME_IS_VALID (now))
+        return;
+
+      error = (gint64) now - (cef_pts + mOffset);
+
+      if (!mMapped || ABS (error - mDrift) > CEF_SRC_AUDIO_RESYNC_THRESHOLD) {
+        if (mMapped) {
+          GST_WARNING_OBJECT (src, "Audio timestamps off by %" GST_STIME_FORMAT ", resyncing",
+              GST_STIME_ARGS (error));
+          GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
+        }
+        mOffset = (gint64) now - cef_pts;
+        mDrift = 0;
+        mMapped = TRUE;
+      } else {
+        mDrift += (error - mDrift) / 64;
+
+        if (ABS (mDrift) > CEF_SRC_AUDIO_DRIFT_TOLERANCE) {
+          gint64 max_step = gst_util_uint64_scale (duration, CEF_SRC_AUDIO_MAX_SLEW_PPM, 1000000);
+          gint64 tolerance = CEF_SRC_AUDIO_DRIFT_TOLERANCE;
+          gint64 excess = mDrift > 0 ? mDrift - tolerance : mDrift + tolerance;
+          gint64 step = CLAMP (excess, -max_step, max_step);
+
+          mOffset += step;
+          mDrift -= step;
+        }
+      }
+
+      pts = cef_pts + mOffset;
+      GST_BUFFER_PTS (buf) = pts > 0 ? (GstClockTime) pts : 0;
+    }
+
+    /* Packets keep the same size while a stream plays, so their buffers
+     * come from a pool, recreated when the size changes. It never blocks:
+     * when all buffers are downstream, new ones get allocated. */
+    GstBuffer *AcquireBuffer(gsize size)
+    {
+      GstBuffer *buf = NULL;
+
+      if (size != mPoolSize) {
+        GstStructure *config;
+
+        ReleasePool();
+
+        mPool = gst_buffer_pool_new ();
+        config = gst_buffer_pool_get_config (mPool);
+        gst_buffer_pool_config_set_params (config, NULL, size, 0, 0);
+        if (!gst_buffer_pool_set_config (mPool, config) ||
+            !gst_buffer_pool_set_active (mPool, TRUE)) {
+          GST_WARNING_OBJECT (src, "Failed to set up audio buffer pool");
+          gst_clear_object (&mPool);
+        }
+        mPoolSize = size;
+      }
+
+      if (!mPool || gst_buffer_pool_acquire_buffer (mPool, &buf, NULL) != GST_FLOW_OK)
+        buf = gst_buffer_new_allocate (NULL, size, NULL);
+
+      return buf;
+    }
+
+    void ReleasePool()
+    {
+      if (mPool) {
+        gst_buffer_pool_set_active (mPool, FALSE);
+        gst_clear_object (&mPool);
+      }
+      mPoolSize = 0;
+    }
+
     GstCefSrc *src;
     gint mRate;
     gint mChannels;
+    GstBufferPool *mPool = NULL;
+    gsize mPoolSize = 0;
+    /* Running time minus CEF time, and its smoothed error */
+    gboolean mMapped = FALSE;
+    gint64 mOffset = 0;
+    gint64 mDrift = 0;
     IMPLEMENT_REFCOUNTING(AudioHandler);
 };
 
@@ -394,6 +1315,66 @@ private:
   IMPLEMENT_REFCOUNTING(DisplayHandler);
 };
 
+/* Non-live rendering: paint the view now, whether it changed or not */
+static void
+gst_cef_src_send_begin_frame (GstCefSrc *src)
+{
+  CEF_REQUIRE_UI_THREAD();
+
+  if (!src->browser)
+    return;
+
+  src->browser->GetHost()->Invalidate(PET_VIEW);
+  src->browser->GetHost()->SendExternalBeginFrame();
+}
+
+/* Let the page's virtual time run for one output frame, the begin frame
+ * is sent once DevTools reports the budget as expired */
+static void
+gst_cef_src_advance_virtual_time (GstCefSrc *src, double budget_ms)
+{
+  CefRefPtr<CefDictionaryValue> params;
+
+  CEF_REQUIRE_UI_THREAD();
+
+  if (!src->browser)
+    return;
+
+  params = CefDictionaryValue::Create();
+  params->SetString("policy", "pauseIfNetworkFetchesPending");
+  params->SetDouble("budget", budget_ms);
+
+  if (!src->browser->GetHost()->ExecuteDevToolsMethod(0, "Emulation.setVirtualTimePolicy", params)) {
+    GST_WARNING_OBJECT (src, "Failed to advance virtual time");
+    gst_cef_src_send_begin_frame (src);
+  }
+}
+
+class DevToolsObserver : public CefDevToolsMessageObserver
+{
+  public:
+
+    DevToolsObserver(GstCefSrc *src) :
+        src (src)
+    {
+    }
+
+    void OnDevToolsEvent(CefRefPtr<CefBrowser> browser,
+                         const CefString& method,
+                         const void* params,
+                         size_t params_size) override
+    {
+      if (method == "Emulation.virtualTimeBudgetExpired")
+        gst_cef_src_send_begin_frame (src);
+    }
+
+  private:
+
+    GstCefSrc *src;
+
+    IMPLEMENT_REFCOUNTING(DevToolsObserver);
+};
+
 class BrowserClient :
   public CefClient,
   public CefLifeSpanHandler,
@@ -516,6 +1497,7 @@ class BrowserClient :
       CefBrowserSettings browser_settings;
 
       window_info.SetAsWindowless(0);
+      window_info.external_begin_frame_enabled = !src->is_live;
       browser = CefBrowserHost::CreateBrowserSync(
         window_info,
         this,
@@ -527,6 +1509,15 @@ class BrowserClient :
 
       browser->GetHost()->SetAudioMuted(true);
 
+      if (!src->is_live) {
+        CefRefPtr<CefDictionaryValue> params = CefDictionaryValue::Create();
+
+        /* Page time only moves forward when we render a frame */
+        devtools_registration_ = browser->GetHost()->AddDevToolsMessageObserver(new DevToolsObserver(src));
+        params->SetString("policy", "pause");
+        browser->GetHost()->ExecuteDevToolsMethod(0, "Emulation.setVirtualTimePolicy", params);
+      }
+
       src->browser = browser;
 
       g_mutex_lock (&src->state_lock);
@@ -540,6 +1531,8 @@ class BrowserClient :
     CefRefPtr<CefMessageRouterBrowserSide> browser_msg_router_;
     std::unique_ptr<CefMessageRouterBrowserSide::Handler> browser_msg_handler_;
 
+    CefRefPtr<CefRegistration> devtools_registration_;
+
     CefRefPtr<CefRenderHandler> render_handler;
     CefRefPtr<CefAudioHandler> audio_handler;
     CefRefPtr<CefDisplayHandler> display_handler;
@@ -583,99 +1576,715 @@ void BrowserApp::OnScheduleMessagePumpWork(int64_t delay_ms)
       // Never wait longer than the maximum allowed time.
       if (timer_delay_ms > kMaxTimerDelay) timer_delay_ms = kMaxTimerDelay;
 
-      workTimer_ = gst_cef_domessagework((double)timer_delay_ms * (1.0 / 1000.0));
+      workTimer_ = gst_cef_domessagework((double)timer_delay_ms * (1.0 / 1000.0));
+
+      CFRunLoopAddTimer(CFRunLoopGetMain(), workTimer_, kCFRunLoopDefaultMode);
+  }
+}
+#endif
+
+void BrowserApp::OnBeforeCommandLineProcessing(const CefString &process_type,
+                                               CefRefPtr<CefCommandLine> command_line)
+{
+    command_line->AppendSwitchWithValue("autoplay-policy", "no-user-gesture-required");
+    command_line->AppendSwitch("enable-media-stream");
+    command_line->AppendSwitch("disable-dev-shm-usage"); /* https://github.com/GoogleChrome/puppeteer/issues/1834 */
+    command_line->AppendSwitch("enable-begin-frame-scheduling"); /* https://bitbucket.org/chromiumembedded/cef/issues/1368 */
+
+    bool gpu = src->gpu || (!!g_getenv ("GST_CEF_GPU_ENABLED"));
+
+#ifdef __APPLE__
+    command_line->AppendSwitch("off-screen-rendering-enabled");
+    if (gpu) {
+      GST_WARNING_OBJECT(src, "GPU rendering is known not to work on macOS. Disabling it now. See https://github.com/chromiumembedded/cef/issues/3322 and https://magpcss.org/ceforum/viewtopic.php?f=6&t=19397");
+      gpu = FALSE;
+    }
+#endif
+
+    if (!gpu) {
+      // Optimize for no gpu usage
+      command_line->AppendSwitch("disable-gpu");
+      command_line->AppendSwitch("disable-gpu-compositing");
+    }
+
+    if (src->chromium_debug_port >= 0) {
+      command_line->AppendSwitchWithValue("remote-debugging-port", g_strdup_printf ("%i", src->chromium_debug_port));
+    }
+
+    const gchar *extra_flags = src->chrome_extra_flags;
+    if (!extra_flags) {
+      extra_flags = g_getenv ("GST_CEF_CHROME_EXTRA_FLAGS");
+    }
+
+    if (extra_flags) {
+      gchar **flags_list = g_strsplit (extra_flags, ",", -1);
+      guint i;
+
+      for (i = 0; i < g_strv_length (flags_list); i++) {
+        gchar **switch_value = g_strsplit ((const gchar *) flags_list[i], "=", -1);
+
+        if (g_strv_length (switch_value) > 1) {
+          GST_INFO_OBJECT (src, "Adding switch with value %s=%s", switch_value[0], switch_value[1]);
+          command_line->AppendSwitchWithValue (switch_value[0], switch_value[1]);
+        } else {
+          GST_INFO_OBJECT (src, "Adding flag %s", flags_list[i]);
+          command_line->AppendSwitch (flags_list[i]);
+        }
+
+        g_strfreev (switch_value);
+      }
+
+      g_strfreev (flags_list);
+    }
+}
+
+
+/** cefsrc (Gstreamer) methods */
+
+/* CEF paints at an integer rate of at most CEF_SRC_MAX_PAINT_RATE. Round
+ * up, so fractional rates like 60000/1001 drop the odd extra paint rather
+ * than repeat a frame every second, and above the maximum show each paint
+ * for the smallest number of frames that works. */
+static gint
+gst_cef_src_get_paint_rate (gint fps_n, gint fps_d, guint *cadence)
+{
+  guint k = 1;
+
+  if (fps_n <= 0 || fps_d <= 0) {
+    *cadence = 1;
+    return DEFAULT_FPS_N / DEFAULT_FPS_D;
+  }
+
+  while (gst_util_uint64_scale_ceil (1, fps_n, (guint64) fps_d * k) > CEF_SRC_MAX_PAINT_RATE)
+    k++;
+
+  *cadence = k;
+
+  return (gint) gst_util_uint64_scale_ceil (1, fps_n, (guint64) fps_d * k);
+}
+
+/* Whether the next output frame must keep showing the frame its cadence
+ * started with */
+static gboolean
+gst_cef_src_holds_frame (GstCefSrc *src)
+{
+  return src->cadence > 1 && src->cadence_frame && src->n_frames % src->cadence != 0;
+}
+
+/* Immediate audio mode only applies in live mode, and with cefdemux
+ * downstream to take the audio-only buffers apart */
+static gboolean
+gst_cef_src_immediate_audio (GstCefSrc *src)
+{
+  return src->is_live && src->audio_mode == CEF_SRC_AUDIO_MODE_IMMEDIATE &&
+      src->audio_only_buffers;
+}
+
+/* Whether the next buffer would only repeat the previous one: no paint
+ * happened since (or the current frame is held) and no audio waits to
+ * be attached to a buffer, unless it goes out on its own */
+static gboolean
+gst_cef_src_is_repeat (GstCefSrc *src)
+{
+  gboolean audio_pending;
+
+  if (!g_atomic_pointer_get (&src->current_buffer))
+    return FALSE;
+
+  if (!gst_cef_src_holds_frame (src) &&
+      g_atomic_int_get (&src->latest_generation) != (gint) src->last_generation)
+    return FALSE;
+
+  if (gst_cef_src_immediate_audio (src))
+    return TRUE;
+
+  GST_OBJECT_LOCK (src);
+  audio_pending = gst_cef_audio_queue_get_level (src->audio_queue) ||
+      !g_queue_is_empty (&src->audio_events);
+  GST_OBJECT_UNLOCK (src);
+
+  return !audio_pending;
+}
+
+/* Returned by the waits below when audio should go out on its own */
+#define GST_CEF_SRC_FLOW_AUDIO GST_FLOW_CUSTOM_SUCCESS
+
+/* Monotonic time at which the clock reaches @running_time */
+static gint64
+gst_cef_src_get_deadline (GstCefSrc *src, GstClockTime running_time)
+{
+  GstClockTime now = gst_cef_src_get_running_time (src);
+  gint64 deadline = g_get_monotonic_time ();
+
+  if (GST_CLOCK_TIME_IS_VALID (now) && running_time > now)
+    deadline += (running_time - now) / GST_USECOND;
+
+  return deadline;
+}
+
+/* Variable framerate mode: when a keep-alive frame is due, -1 without
+ * a min-framerate */
+static gint64
+gst_cef_src_get_keep_alive_deadline (GstCefSrc *src)
+{
+  gint64 deadline;
+
+  if (!src->min_fps_n)
+    return -1;
+
+  deadline = src->last_push_time != -1 ? src->last_push_time : g_get_monotonic_time ();
+  deadline += gst_util_uint64_scale_int (G_TIME_SPAN_SECOND, src->min_fps_d, src->min_fps_n);
+
+  return deadline;
+}
+
+/* Immediate audio mode: wait until @deadline (or for a new paint in
+ * variable framerate mode), but wake up as soon as audio is queued */
+static GstFlowReturn
+gst_cef_src_wait_for_audio (GstCefSrc *src, gint64 deadline)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  g_mutex_lock (&src->paint_lock);
+  while (TRUE) {
+    gboolean flushing, audio_pending;
+
+    GST_OBJECT_LOCK (src);
+    flushing = src->flushing;
+    audio_pending = gst_cef_audio_queue_get_level (src->audio_queue) > 0;
+    GST_OBJECT_UNLOCK (src);
+
+    if (flushing) {
+      ret = GST_FLOW_FLUSHING;
+      break;
+    }
+
+    if (audio_pending) {
+      ret = GST_CEF_SRC_FLOW_AUDIO;
+      break;
+    }
+
+    if (src->variable_framerate && g_atomic_pointer_get (&src->current_buffer) &&
+        g_atomic_int_get (&src->latest_generation) != (gint) src->last_generation)
+      break;
+
+    if (deadline == -1)
+      g_cond_wait (&src->paint_cond, &src->paint_lock);
+    else if (!g_cond_wait_until (&src->paint_cond, &src->paint_lock, deadline))
+      break;
+  }
+  g_mutex_unlock (&src->paint_lock);
+
+  return ret;
+}
+
+/* basesrc sends the segment along with the first buffer create()
+ * returns, and again after flushes */
+static gboolean
+gst_cef_src_segment_sent (GstCefSrc *src)
+{
+  GstEvent *segment = gst_pad_get_sticky_event (GST_BASE_SRC_PAD (src), GST_EVENT_SEGMENT, 0);
+
+  if (!segment)
+    return FALSE;
+
+  gst_event_unref (segment);
+  return TRUE;
+}
+
+/* Send GAP events at the output framerate until there is something new
+ * to output. Before the segment went out, time only passes. */
+static GstFlowReturn
+gst_cef_src_wait_for_paint (GstCefSrc *src)
+{
+  while (gst_cef_src_is_repeat (src)) {
+    GstClockTime timestamp, duration;
+    GstClockReturn clock_ret;
+    GstClockID id;
+    GstClock *clock;
+
+    timestamp = gst_util_uint64_scale (src->n_frames, src->vinfo.fps_d * GST_SECOND, src->vinfo.fps_n);
+    duration = gst_util_uint64_scale (GST_SECOND, src->vinfo.fps_d, src->vinfo.fps_n);
+
+    if (gst_cef_src_segment_sent (src)) {
+      GST_LOG_OBJECT (src, "No new paint, sending gap at %" GST_TIME_FORMAT, GST_TIME_ARGS (timestamp));
+      gst_pad_push_event (GST_BASE_SRC_PAD (src), gst_event_new_gap (timestamp, duration));
+      gst_cef_src_stat_add (src->n_repeated, 1);
+    } else {
+      GST_LOG_OBJECT (src, "No first paint yet at %" GST_TIME_FORMAT, GST_TIME_ARGS (timestamp));
+    }
+    gst_cef_src_stat_add (src->n_frames, 1);
+
+    GST_OBJECT_LOCK (src);
+    if (src->flushing) {
+      GST_OBJECT_UNLOCK (src);
+      return GST_FLOW_FLUSHING;
+    }
+
+    clock = GST_ELEMENT_CLOCK (src);
+    if (!clock) {
+      GST_OBJECT_UNLOCK (src);
+      break;
+    }
+
+    if (gst_cef_src_immediate_audio (src)) {
+      GstFlowReturn ret;
+
+      GST_OBJECT_UNLOCK (src);
+      ret = gst_cef_src_wait_for_audio (src, gst_cef_src_get_deadline (src, timestamp + duration));
+      if (ret != GST_FLOW_OK)
+        return ret;
+      continue;
+    }
+
+    id = gst_clock_new_single_shot_id (clock,
+        GST_ELEMENT_CAST (src)->base_time + timestamp + duration);
+    src->clock_id = id;
+    GST_OBJECT_UNLOCK (src);
+
+    clock_ret = gst_clock_id_wait (id, NULL);
+
+    GST_OBJECT_LOCK (src);
+    src->clock_id = NULL;
+    GST_OBJECT_UNLOCK (src);
+    gst_clock_id_unref (id);
+
+    if (clock_ret == GST_CLOCK_UNSCHEDULED)
+      return GST_FLOW_FLUSHING;
+  }
+
+  return GST_FLOW_OK;
+}
+
+/* Variable framerate mode: wait for the paint handler to publish a new
+ * frame, or for the keep-alive interval to expire */
+static GstFlowReturn
+gst_cef_src_wait_for_new_paint (GstCefSrc *src)
+{
+  gint64 deadline = gst_cef_src_get_keep_alive_deadline (src);
+
+  g_mutex_lock (&src->paint_lock);
+  while (!g_atomic_pointer_get (&src->current_buffer) ||
+      g_atomic_int_get (&src->latest_generation) == (gint) src->last_generation) {
+    gboolean flushing;
+
+    GST_OBJECT_LOCK (src);
+    flushing = src->flushing;
+    GST_OBJECT_UNLOCK (src);
+
+    if (flushing) {
+      g_mutex_unlock (&src->paint_lock);
+      return GST_FLOW_FLUSHING;
+    }
+
+    if (deadline == -1) {
+      g_cond_wait (&src->paint_cond, &src->paint_lock);
+    } else if (!g_cond_wait_until (&src->paint_cond, &src->paint_lock, deadline)) {
+      GST_LOG_OBJECT (src, "No paint in time, sending keep-alive frame");
+      break;
+    }
+  }
+  g_mutex_unlock (&src->paint_lock);
+
+  return GST_FLOW_OK;
+}
+
+/* Non-live mode: have Chromium render the next frame and wait for it */
+static GstFlowReturn
+gst_cef_src_render_frame (GstCefSrc *src)
+{
+  double budget_ms = (double) src->vinfo.fps_d * 1000.0 / src->vinfo.fps_n;
+  gint64 deadline = g_get_monotonic_time () + CEF_SRC_BEGIN_FRAME_TIMEOUT;
+
+  CefPostTask(TID_UI, base::BindOnce(&gst_cef_src_advance_virtual_time, src, budget_ms));
+
+  g_mutex_lock (&src->paint_lock);
+  while (!g_atomic_pointer_get (&src->current_buffer) ||
+      g_atomic_int_get (&src->latest_generation) == (gint) src->last_generation) {
+    gboolean flushing;
+
+    GST_OBJECT_LOCK (src);
+    flushing = src->flushing;
+    GST_OBJECT_UNLOCK (src);
+
+    if (flushing) {
+      g_mutex_unlock (&src->paint_lock);
+      return GST_FLOW_FLUSHING;
+    }
+
+    if (!g_cond_wait_until (&src->paint_cond, &src->paint_lock, deadline)) {
+      GST_WARNING_OBJECT (src, "Timed out waiting for frame %" G_GUINT64_FORMAT, gst_cef_src_stat_get (src->n_frames));
+      break;
+    }
+  }
+  g_mutex_unlock (&src->paint_lock);
+
+  return GST_FLOW_OK;
+}
+
+static gint
+gst_cef_src_compare_latencies (gconstpointer a, gconstpointer b)
+{
+  GstClockTime la = *(const GstClockTime *) a, lb = *(const GstClockTime *) b;
+
+  return la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+/* Must be called with the object lock held, returns the number of
+ * samples copied to @sorted */
+static guint
+gst_cef_src_sort_latencies (const GstClockTime *samples, guint64 n_samples,
+    GstClockTime *sorted)
+{
+  guint n = (guint) MIN (n_samples, CEF_SRC_N_LATENCY_SAMPLES);
+
+  memcpy (sorted, samples, n * sizeof (GstClockTime));
+  qsort (sorted, n, sizeof (GstClockTime), gst_cef_src_compare_latencies);
+
+  return n;
+}
+
+static GstClockTime
+gst_cef_src_latency_percentile (const GstClockTime *sorted, guint n, guint percent)
+{
+  return n ? sorted[(n - 1) * percent / 100] : GST_CLOCK_TIME_NONE;
+}
+
+/* Live latency is what create() adds (a frame duration, except in
+ * variable framerate mode where buffers are timestamped back to their
+ * paint) plus the worst delay buffers see before being pushed: video
+ * from OnPaint, audio from the audio handler. The 99th percentile of
+ * those goes in @min, the largest one in @max. */
+static void
+gst_cef_src_get_latency (GstCefSrc *src, GstClockTime *min, GstClockTime *max)
+{
+  GstClockTime video[CEF_SRC_N_LATENCY_SAMPLES], audio[CEF_SRC_N_LATENCY_SAMPLES];
+  GstClockTime base = 0;
+  guint n_video, n_audio;
+
+  GST_OBJECT_LOCK (src);
+  n_video = gst_cef_src_sort_latencies (src->latency_samples, src->n_latency_samples, video);
+  n_audio = gst_cef_src_sort_latencies (src->audio_latency_samples,
+      src->n_audio_latency_samples, audio);
+  if (!src->variable_framerate && src->vinfo.fps_n)
+    base = gst_util_uint64_scale (GST_SECOND, src->vinfo.fps_d, src->vinfo.fps_n);
+  GST_OBJECT_UNLOCK (src);
+
+  *min = base;
+  *max = GST_CLOCK_TIME_NONE;
+
+  if (n_video || n_audio) {
+    GstClockTime worst = 0, highest = 0;
+
+    if (n_video) {
+      worst = gst_cef_src_latency_percentile (video, n_video, 99);
+      highest = video[n_video - 1];
+    }
+    if (n_audio) {
+      worst = MAX (worst, gst_cef_src_latency_percentile (audio, n_audio, 99));
+      highest = MAX (highest, audio[n_audio - 1]);
+    }
+
+    *min = base + worst;
+    *max = base + highest;
+  }
+}
+
+/* Asks the pipeline to query latency again once measurements moved
+ * away from what we last reported: above it, or well below it */
+static void
+gst_cef_src_check_latency (GstCefSrc *src)
+{
+  GstClockTime min, max, reported;
+
+  if (!src->is_live || src->n_frames % CEF_SRC_LATENCY_CHECK_INTERVAL)
+    return;
+
+  GST_OBJECT_LOCK (src);
+  reported = src->reported_latency;
+  GST_OBJECT_UNLOCK (src);
+
+  if (!GST_CLOCK_TIME_IS_VALID (reported))
+    return;
+
+  gst_cef_src_get_latency (src, &min, &max);
+  if (min <= reported && min >= reported / 4 * 3)
+    return;
+
+  GST_INFO_OBJECT (src, "Latency moved from %" GST_TIME_FORMAT " to %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (reported), GST_TIME_ARGS (min));
+
+  GST_OBJECT_LOCK (src);
+  src->reported_latency = GST_CLOCK_TIME_NONE;
+  GST_OBJECT_UNLOCK (src);
+
+  gst_element_post_message (GST_ELEMENT (src), gst_message_new_latency (GST_OBJECT (src)));
+}
+
+static GstStructure *
+gst_cef_src_get_stats (GstCefSrc *src)
+{
+  GstClockTime latencies[CEF_SRC_N_LATENCY_SAMPLES];
+  guint n_latencies, n_audio_packets, n_audio_dropped, audio_queue_max;
+  guint64 dirty_pixels, view_pixels;
+
+  GST_OBJECT_LOCK (src);
+  n_latencies = gst_cef_src_sort_latencies (src->latency_samples, src->n_latency_samples, latencies);
+  GST_OBJECT_UNLOCK (src);
+
+  gst_cef_audio_queue_get_stats (src->audio_queue, &n_audio_packets, &n_audio_dropped,
+      &audio_queue_max);
+
+  /* Counters are read as they are, writers never wait for us */
+  dirty_pixels = gst_cef_src_stat_get (src->dirty_pixels);
+  view_pixels = gst_cef_src_stat_get (src->view_pixels);
+
+  return gst_structure_new ("GstCefSrcStats",
+      "paints", G_TYPE_UINT64, gst_cef_src_stat_get (src->n_paints),
+      "published", G_TYPE_UINT64, gst_cef_src_stat_get (src->n_published),
+      "bytes-copied", G_TYPE_UINT64, gst_cef_src_stat_get (src->bytes_copied),
+      "dirty-ratio", G_TYPE_DOUBLE,
+          view_pixels ? (gdouble) dirty_pixels / view_pixels : 0.0,
+      "frames-output", G_TYPE_UINT64, gst_cef_src_stat_get (src->n_frames),
+      "frames-repeated", G_TYPE_UINT64, gst_cef_src_stat_get (src->n_repeated),
+      "frames-dropped", G_TYPE_UINT64, gst_cef_src_stat_get (src->n_dropped),
+      "frames-busy", G_TYPE_UINT64, gst_cef_src_stat_get (src->n_frames_busy),
+      "handoff-races", G_TYPE_UINT64, gst_cef_src_stat_get (src->n_handoff_races),
+      "latency-p50", G_TYPE_UINT64, gst_cef_src_latency_percentile (latencies, n_latencies, 50),
+      "latency-p90", G_TYPE_UINT64, gst_cef_src_latency_percentile (latencies, n_latencies, 90),
+      "latency-p99", G_TYPE_UINT64, gst_cef_src_latency_percentile (latencies, n_latencies, 99),
+      "audio-packets", G_TYPE_UINT64, (guint64) n_audio_packets,
+      "audio-dropped", G_TYPE_UINT64, (guint64) n_audio_dropped,
+      "audio-queue-depth", G_TYPE_UINT, gst_cef_audio_queue_get_level (src->audio_queue),
+      "audio-queue-max", G_TYPE_UINT, audio_queue_max,
+      "paint-time", G_TYPE_UINT64, gst_cef_src_stat_get (src->paint_duration),
+      "paint-time-max", G_TYPE_UINT64, gst_cef_src_stat_get (src->paint_duration_max),
+      NULL);
+}
+
+/* Called from the streaming thread after every buffer */
+static void
+gst_cef_src_post_stats (GstCefSrc *src)
+{
+  guint interval = (guint) g_atomic_int_get (&src->stats_interval);
+  gint64 now;
+
+  if (!interval)
+    return;
+
+  now = g_get_monotonic_time ();
+  if (src->last_stats_time >= 0 && now - src->last_stats_time < interval * G_TIME_SPAN_MILLISECOND)
+    return;
+
+  src->last_stats_time = now;
+  gst_element_post_message (GST_ELEMENT (src),
+      gst_message_new_element (GST_OBJECT (src), gst_cef_src_get_stats (src)));
+}
+
+static void
+gst_cef_src_mark_repeat (GstCefSrc *src, GstBuffer *buf)
+{
+  GstCefDamageMeta *dmeta = gst_buffer_get_cef_damage_meta (buf);
+
+  /* Nothing changed since the previous buffer */
+  if (dmeta)
+    dmeta->n_rects = 0;
+
+  if (src->duplicate_mode != CEF_SRC_DUPLICATE_MODE_NONE) {
+    GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_GAP);
+    GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DROPPABLE);
+  }
+  gst_cef_src_stat_add (src->n_repeated, 1);
+}
+
+/* Only take what the audio handler queued up so far, events get pushed
+ * without holding the lock. Returns NULL without audio. */
+static GstBufferList *
+gst_cef_src_take_audio (GstCefSrc *src)
+{
+  GstBufferList *audio_buffers = NULL;
+  GstClockTime now, pts = GST_CLOCK_TIME_NONE;
+  GstEvent *event;
+  GQueue audio_events;
+  guint i, n_buffers;
+
+  GST_OBJECT_LOCK (src);
+  audio_events = src->audio_events;
+  g_queue_init (&src->audio_events);
+  GST_OBJECT_UNLOCK (src);
+
+  while ((event = (GstEvent *) g_queue_pop_head (&audio_events)))
+    gst_pad_push_event (GST_BASE_SRC_PAD (src), event);
+
+  n_buffers = gst_cef_audio_queue_get_level (src->audio_queue);
+  for (i = 0; i < n_buffers; i++) {
+    GstBuffer *buffer = gst_cef_audio_queue_pop (src->audio_queue);
+
+    /* Dropped to make room in the meantime */
+    if (!buffer)
+      break;
+
+    if (!audio_buffers) {
+      audio_buffers = gst_buffer_list_new_sized (n_buffers);
+      pts = GST_BUFFER_PTS (buffer);
+    }
+    gst_buffer_list_add (audio_buffers, buffer);
+  }
 
-      CFRunLoopAddTimer(CFRunLoopGetMain(), workTimer_, kCFRunLoopDefaultMode);
+  now = gst_cef_src_get_running_time (src);
+  if (GST_CLOCK_TIME_IS_VALID (pts) && GST_CLOCK_TIME_IS_VALID (now)) {
+    GST_OBJECT_LOCK (src);
+    src->audio_latency_samples[src->n_audio_latency_samples++ % CEF_SRC_N_LATENCY_SAMPLES] =
+        now > pts ? now - pts : 0;
+    GST_OBJECT_UNLOCK (src);
   }
+
+  return audio_buffers;
 }
-#endif
 
-void BrowserApp::OnBeforeCommandLineProcessing(const CefString &process_type,
-                                               CefRefPtr<CefCommandLine> command_line)
+/* Immediate audio mode: queued audio goes out in an empty buffer
+ * flagged GAP and DROPPABLE, cefdemux only pushes its audio meta */
+static GstFlowReturn
+gst_cef_src_create_audio_buffer (GstCefSrc *src, GstBufferList *audio_buffers, GstBuffer **buf)
 {
-    command_line->AppendSwitchWithValue("autoplay-policy", "no-user-gesture-required");
-    command_line->AppendSwitch("enable-media-stream");
-    command_line->AppendSwitch("disable-dev-shm-usage"); /* https://github.com/GoogleChrome/puppeteer/issues/1834 */
-    command_line->AppendSwitch("enable-begin-frame-scheduling"); /* https://bitbucket.org/chromiumembedded/cef/issues/1368 */
+  GstClockTime pts;
 
-    bool gpu = src->gpu || (!!g_getenv ("GST_CEF_GPU_ENABLED"));
+  pts = GST_BUFFER_PTS (gst_buffer_list_get (audio_buffers, 0));
+  if (!GST_CLOCK_TIME_IS_VALID (pts))
+    pts = gst_cef_src_get_running_time (src);
 
-#ifdef __APPLE__
-    command_line->AppendSwitch("off-screen-rendering-enabled");
-    if (gpu) {
-      GST_WARNING_OBJECT(src, "GPU rendering is known not to work on macOS. Disabling it now. See https://github.com/chromiumembedded/cef/issues/3322 and https://magpcss.org/ceforum/viewtopic.php?f=6&t=19397");
-      gpu = FALSE;
-    }
-#endif
+  *buf = gst_buffer_new ();
+  GST_BUFFER_FLAG_SET (*buf, GST_BUFFER_FLAG_GAP);
+  GST_BUFFER_FLAG_SET (*buf, GST_BUFFER_FLAG_DROPPABLE);
+  GST_BUFFER_PTS (*buf) = pts;
+  gst_buffer_add_cef_audio_meta (*buf, audio_buffers)->pts = pts;
 
-    if (!gpu) {
-      // Optimize for no gpu usage
-      command_line->AppendSwitch("disable-gpu");
-      command_line->AppendSwitch("disable-gpu-compositing");
-    }
+  return GST_FLOW_OK;
+}
 
-    if (src->chromium_debug_port >= 0) {
-      command_line->AppendSwitchWithValue("remote-debugging-port", g_strdup_printf ("%i", src->chromium_debug_port));
-    }
+static GstFlowReturn gst_cef_src_create(GstPushSrc *push_src, GstBuffer **buf)
+{
+  GstCefSrc *src = GST_CEF_SRC (push_src);
+  gboolean immediate_audio = gst_cef_src_immediate_audio (src);
+  GstBufferList *audio_buffers;
+  GstBuffer *frame;
+  GstClockTime paint_time = GST_CLOCK_TIME_NONE;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if (!src->is_live) {
+    ret = gst_cef_src_render_frame (src);
+  } else if (src->variable_framerate) {
+    if (immediate_audio)
+      ret = gst_cef_src_wait_for_audio (src, gst_cef_src_get_keep_alive_deadline (src));
+    if (ret == GST_FLOW_OK)
+      ret = gst_cef_src_wait_for_new_paint (src);
+  } else if (src->duplicate_mode == CEF_SRC_DUPLICATE_MODE_GAP) {
+    ret = gst_cef_src_wait_for_paint (src);
+  } else if (immediate_audio) {
+    GstClockTime timestamp = gst_util_uint64_scale (src->n_frames,
+        src->vinfo.fps_d * GST_SECOND, src->vinfo.fps_n);
+
+    ret = gst_cef_src_wait_for_audio (src, gst_cef_src_get_deadline (src, timestamp));
+  }
 
-    const gchar *extra_flags = src->chrome_extra_flags;
-    if (!extra_flags) {
-      extra_flags = g_getenv ("GST_CEF_CHROME_EXTRA_FLAGS");
-    }
+  if (ret != GST_FLOW_OK && ret != GST_CEF_SRC_FLOW_AUDIO)
+    return ret;
 
-    if (extra_flags) {
-      gchar **flags_list = g_strsplit (extra_flags, ",", -1);
-      guint i;
+  audio_buffers = gst_cef_src_take_audio (src);
 
-      for (i = 0; i < g_strv_length (flags_list); i++) {
-        gchar **switch_value = g_strsplit ((const gchar *) flags_list[i], "=", -1);
+  /* Unless it all got dropped to make room in the meantime */
+  if (ret == GST_CEF_SRC_FLOW_AUDIO && audio_buffers)
+    return gst_cef_src_create_audio_buffer (src, audio_buffers, buf);
 
-        if (g_strv_length (switch_value) > 1) {
-          GST_INFO_OBJECT (src, "Adding switch with value %s=%s", switch_value[0], switch_value[1]);
-          command_line->AppendSwitchWithValue (switch_value[0], switch_value[1]);
-        } else {
-          GST_INFO_OBJECT (src, "Adding flag %s", flags_list[i]);
-          command_line->AppendSwitch (flags_list[i]);
-        }
+  /* Take the latest frame out of the slot for the time it takes to share
+   * its memory, then hand it back unless a newer one got published */
+  if (gst_cef_src_holds_frame (src)) {
+    *buf = gst_buffer_copy (src->cadence_frame);
+    gst_cef_src_mark_repeat (src, *buf);
+  } else if ((frame = gst_cef_src_exchange_current_buffer (src, NULL))) {
+    guint64 generation = GST_BUFFER_OFFSET (frame);
 
-        g_strfreev (switch_value);
-      }
+    *buf = gst_buffer_copy (frame);
 
-      g_strfreev (flags_list);
-    }
-}
+    /* Keeping a reference also stops the paint handler from reusing it */
+    if (src->cadence > 1)
+      gst_buffer_replace (&src->cadence_frame, frame);
 
+    if (!g_atomic_pointer_compare_and_exchange (&src->current_buffer, NULL, frame)) {
+      gst_cef_src_stat_add (src->n_handoff_races, 1);
+      gst_buffer_unref (frame);
+    }
 
-/** cefsrc (Gstreamer) methods */
+    if (generation == src->last_generation) {
+      gst_cef_src_mark_repeat (src, *buf);
+    } else {
+      paint_time = GST_BUFFER_PTS (frame);
+      gst_cef_src_stat_add (src->n_dropped, generation - src->last_generation - 1);
+      g_atomic_int_set (&src->consumed_generation, (gint) generation);
+    }
+    src->last_generation = generation;
+  } else {
+    GstCefConvertMatrix matrix;
+    GstVideoFrame vframe;
+    GstCefDamage damage;
+
+    /* Nothing painted yet, send out a transparent (or black) frame */
+    ret = GST_BASE_SRC_CLASS (parent_class)->alloc (GST_BASE_SRC (src), 0, src->vinfo.size, buf);
+    if (ret != GST_FLOW_OK) {
+      if (audio_buffers)
+        gst_buffer_list_unref (audio_buffers);
+      return ret;
+    }
+    if (GST_VIDEO_INFO_FORMAT (&src->vinfo) == GST_VIDEO_FORMAT_BGRA) {
+      gst_buffer_memset (*buf, 0, 0, gst_buffer_get_size (*buf));
+    } else if (gst_video_frame_map (&vframe, &src->vinfo, *buf, GST_MAP_WRITE)) {
+      gst_cef_convert_matrix_init (&matrix, &src->vinfo);
+      gst_cef_convert_fill_black (&matrix, &vframe);
+      gst_video_frame_unmap (&vframe);
+    }
+    gst_cef_damage_clear (&damage);
+    gst_cef_damage_add_full (&damage, src->vinfo.width, src->vinfo.height);
+    gst_cef_src_set_frame_damage (*buf, &damage);
+  }
 
-static GstFlowReturn gst_cef_src_create(GstPushSrc *push_src, GstBuffer **buf)
-{
-  GstCefSrc *src = GST_CEF_SRC (push_src);
-  GList *tmp;
+  if (src->variable_framerate) {
+    GstClockTime pts = gst_cef_src_get_running_time (src);
 
-  GST_OBJECT_LOCK (src);
+    /* Go back to when the frame was painted */
+    if (GST_CLOCK_TIME_IS_VALID (pts) && GST_CLOCK_TIME_IS_VALID (paint_time)) {
+      GstClockTime age = g_get_monotonic_time () * GST_USECOND - paint_time;
 
-  if (src->audio_events) {
-    for (tmp = src->audio_events; tmp; tmp = tmp->next) {
-      gst_pad_push_event (GST_BASE_SRC_PAD (src), (GstEvent *) tmp->data);
+      pts -= MIN (age, pts);
     }
 
-    g_list_free (src->audio_events);
-    src->audio_events = NULL;
+    if (GST_CLOCK_TIME_IS_VALID (pts) && GST_CLOCK_TIME_IS_VALID (src->last_pts) && pts <= src->last_pts)
+      pts = src->last_pts + 1;
+
+    GST_BUFFER_PTS (*buf) = pts;
+    GST_BUFFER_DURATION (*buf) = GST_CLOCK_TIME_NONE;
+    src->last_pts = pts;
+    src->last_push_time = g_get_monotonic_time ();
+  } else {
+    GST_BUFFER_PTS (*buf) = gst_util_uint64_scale (src->n_frames, src->vinfo.fps_d * GST_SECOND, src->vinfo.fps_n);
+    GST_BUFFER_DURATION (*buf) = gst_util_uint64_scale (GST_SECOND, src->vinfo.fps_d, src->vinfo.fps_n);
   }
+  GST_BUFFER_OFFSET (*buf) = src->n_frames;
+  GST_BUFFER_OFFSET_END (*buf) = src->n_frames + 1;
 
-  g_assert (src->current_buffer);
-  *buf = gst_buffer_copy (src->current_buffer);
+  if (audio_buffers)
+    gst_buffer_add_cef_audio_meta (*buf, audio_buffers)->pts = GST_BUFFER_PTS (*buf);
 
-  if (src->audio_buffers) {
-    gst_buffer_add_cef_audio_meta (*buf, src->audio_buffers);
-    src->audio_buffers = NULL;
+  gst_cef_src_stat_add (src->n_frames, 1);
+
+  if (GST_CLOCK_TIME_IS_VALID (paint_time)) {
+    GST_OBJECT_LOCK (src);
+    src->latency_samples[src->n_latency_samples++ % CEF_SRC_N_LATENCY_SAMPLES] =
+        g_get_monotonic_time () * GST_USECOND - paint_time;
+    GST_OBJECT_UNLOCK (src);
   }
 
-  GST_BUFFER_PTS (*buf) = gst_util_uint64_scale (src->n_frames, src->vinfo.fps_d * GST_SECOND, src->vinfo.fps_n);
-  GST_BUFFER_DURATION (*buf) = gst_util_uint64_scale (GST_SECOND, src->vinfo.fps_d, src->vinfo.fps_n);
-  src->n_frames++;
-  GST_OBJECT_UNLOCK (src);
+  gst_cef_src_check_latency (src);
+  gst_cef_src_post_stats (src);
 
   return GST_FLOW_OK;
 }
@@ -874,7 +2483,7 @@ gst_cef_src_change_state(GstElement *src, GstStateChange transition)
     g_mutex_unlock(&init_lock);
 
     GstCefSrc *cefsrc = GST_CEF_SRC (src);
-    gst_buffer_replace (&cefsrc->current_buffer, NULL);
+    gst_cef_src_clear_current_buffer (cefsrc);
 
     break;
   }
@@ -909,8 +2518,35 @@ gst_cef_src_start(GstBaseSrc *base_src)
     goto done;
   }
 
+  if (!src->is_live && src->variable_framerate) {
+    GST_ELEMENT_ERROR (src, LIBRARY, SETTINGS, ("variable-framerate requires is-live"), (NULL));
+    goto done;
+  }
+
+  gst_cef_audio_queue_clear (src->audio_queue);
+  gst_cef_audio_queue_reset_stats (src->audio_queue);
+  gst_cef_audio_queue_set_flushing (src->audio_queue, FALSE);
+
   GST_OBJECT_LOCK (src);
   src->n_frames = 0;
+  src->last_generation = src->paint_generation;
+  src->last_push_time = -1;
+  src->last_pts = GST_CLOCK_TIME_NONE;
+  src->n_published = 0;
+  src->n_frames_busy = 0;
+  src->n_repeated = 0;
+  src->n_dropped = 0;
+  src->n_handoff_races = 0;
+  src->n_paints = 0;
+  src->bytes_copied = 0;
+  src->dirty_pixels = 0;
+  src->view_pixels = 0;
+  src->paint_duration = 0;
+  src->paint_duration_max = 0;
+  src->n_latency_samples = 0;
+  src->n_audio_latency_samples = 0;
+  src->reported_latency = GST_CLOCK_TIME_NONE;
+  src->last_stats_time = -1;
   GST_OBJECT_UNLOCK (src);
 
   GST_ELEMENT_PROGRESS(src, CONTINUE, "open", ("Creating CEF browser ..."));
@@ -973,6 +2609,9 @@ gst_cef_src_stop (GstBaseSrc *base_src)
 
   GST_INFO_OBJECT (src, "Stopping");
 
+  /* The CEF audio thread may be waiting for room in the queue */
+  gst_cef_audio_queue_set_flushing (src->audio_queue, TRUE);
+
   if (src->browser) {
     gst_cef_src_close_browser(src);
 #ifdef __APPLE__
@@ -988,7 +2627,62 @@ gst_cef_src_stop (GstBaseSrc *base_src)
 #endif
   }
 
-  gst_buffer_replace (&src->current_buffer, NULL);
+  GST_INFO_OBJECT (src, "Published %" G_GUINT64_FORMAT " frames, output %"
+      G_GUINT64_FORMAT ", repeated %" G_GUINT64_FORMAT ", dropped %"
+      G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT " allocations with all frames busy, %"
+      G_GUINT64_FORMAT " handoff races", gst_cef_src_stat_get (src->n_published),
+      gst_cef_src_stat_get (src->n_frames), gst_cef_src_stat_get (src->n_repeated),
+      gst_cef_src_stat_get (src->n_dropped), gst_cef_src_stat_get (src->n_frames_busy),
+      gst_cef_src_stat_get (src->n_handoff_races));
+
+  gst_cef_src_clear_current_buffer (src);
+  gst_buffer_replace (&src->cadence_frame, NULL);
+  gst_cef_src_release_frames (src);
+  gst_video_info_init (&src->paint_vinfo);
+  GST_OBJECT_LOCK (src);
+  gst_clear_object (&src->alloc_pool);
+  gst_video_info_init (&src->alloc_vinfo);
+  GST_OBJECT_UNLOCK (src);
+  g_atomic_int_inc (&src->caps_cookie);
+
+  gst_cef_audio_queue_clear (src->audio_queue);
+  GST_OBJECT_LOCK (src);
+  g_queue_clear_full (&src->audio_events, (GDestroyNotify) gst_event_unref);
+  GST_OBJECT_UNLOCK (src);
+
+  return TRUE;
+}
+
+static gboolean
+gst_cef_src_unlock (GstBaseSrc *base_src)
+{
+  GstCefSrc *src = GST_CEF_SRC (base_src);
+
+  GST_OBJECT_LOCK (src);
+  src->flushing = TRUE;
+  if (src->clock_id)
+    gst_clock_id_unschedule (src->clock_id);
+  GST_OBJECT_UNLOCK (src);
+
+  gst_cef_audio_queue_set_flushing (src->audio_queue, TRUE);
+
+  g_mutex_lock (&src->paint_lock);
+  g_cond_broadcast (&src->paint_cond);
+  g_mutex_unlock (&src->paint_lock);
+
+  return TRUE;
+}
+
+static gboolean
+gst_cef_src_unlock_stop (GstBaseSrc *base_src)
+{
+  GstCefSrc *src = GST_CEF_SRC (base_src);
+
+  GST_OBJECT_LOCK (src);
+  src->flushing = FALSE;
+  GST_OBJECT_UNLOCK (src);
+
+  gst_cef_audio_queue_set_flushing (src->audio_queue, FALSE);
 
   return TRUE;
 }
@@ -1000,12 +2694,44 @@ gst_cef_src_get_times (GstBaseSrc * base_src, GstBuffer * buffer,
   GstClockTime timestamp = GST_BUFFER_PTS (buffer);
   GstClockTime duration = GST_BUFFER_DURATION (buffer);
 
-  *end = timestamp + duration;
+  *end = GST_CLOCK_TIME_IS_VALID (duration) ? timestamp + duration : GST_CLOCK_TIME_NONE;
   *start = timestamp;
 
   GST_LOG_OBJECT (base_src, "Got times start: %" GST_TIME_FORMAT " end: %" GST_TIME_FORMAT, GST_TIME_ARGS (*start), GST_TIME_ARGS (*end));
 }
 
+static gboolean
+gst_cef_src_event (GstBaseSrc * base_src, GstEvent * event)
+{
+  GstCefSrc *src = GST_CEF_SRC (base_src);
+
+  /* cefdemux asks for the audio downstream wants, or for none at all,
+   * CEF takes it into account for the next audio stream */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_CUSTOM_UPSTREAM &&
+      gst_event_has_name (event, "cef-audio-params")) {
+    const GstStructure *s = gst_event_get_structure (event);
+    gint rate = 0, channels = 0;
+    gboolean enabled = TRUE;
+
+    gst_structure_get_int (s, "rate", &rate);
+    gst_structure_get_int (s, "channels", &channels);
+    gst_structure_get_boolean (s, "enabled", &enabled);
+
+    GST_INFO_OBJECT (src, "Downstream wants %d channels at %d Hz, audio %s", channels, rate,
+        enabled ? "enabled" : "disabled");
+
+    GST_OBJECT_LOCK (src);
+    src->audio_rate = rate;
+    src->audio_channels = channels;
+    GST_OBJECT_UNLOCK (src);
+    g_atomic_int_set (&src->audio_enabled, enabled);
+
+    return TRUE;
+  }
+
+  return GST_BASE_SRC_CLASS (parent_class)->event (base_src, event);
+}
+
 static gboolean
 gst_cef_src_query (GstBaseSrc * base_src, GstQuery * query)
 {
@@ -1015,12 +2741,22 @@ gst_cef_src_query (GstBaseSrc * base_src, GstQuery * query)
   switch (GST_QUERY_TYPE (query)) {
     case GST_QUERY_LATENCY:
     {
-      GstClockTime latency;
+      GstClockTime min, max;
+
+      if (!src->is_live) {
+        res = GST_BASE_SRC_CLASS (parent_class)->query (base_src, query);
+        break;
+      }
 
       if (src->vinfo.fps_n) {
-        latency = gst_util_uint64_scale (GST_SECOND, src->vinfo.fps_d, src->vinfo.fps_n);
-        GST_DEBUG_OBJECT (src, "Reporting latency: %" GST_TIME_FORMAT, GST_TIME_ARGS (latency));
-        gst_query_set_latency (query, TRUE, latency, GST_CLOCK_TIME_NONE);
+        gst_cef_src_get_latency (src, &min, &max);
+        GST_DEBUG_OBJECT (src, "Reporting latency: min %" GST_TIME_FORMAT " max %"
+            GST_TIME_FORMAT, GST_TIME_ARGS (min), GST_TIME_ARGS (max));
+        gst_query_set_latency (query, TRUE, min, max);
+
+        GST_OBJECT_LOCK (src);
+        src->reported_latency = min;
+        GST_OBJECT_UNLOCK (src);
       }
       res = TRUE;
       break;
@@ -1033,6 +2769,37 @@ gst_cef_src_query (GstBaseSrc * base_src, GstQuery * query)
   return res;
 }
 
+static GstCaps *
+gst_cef_src_get_caps (GstBaseSrc * base_src, GstCaps * filter)
+{
+  GstCefSrc *src = GST_CEF_SRC (base_src);
+  GstCaps *caps, *tmp;
+  guint i;
+
+  caps = gst_pad_get_pad_template_caps (GST_BASE_SRC_PAD (base_src));
+  caps = gst_caps_make_writable (caps);
+
+  /* The template allows both, only offer the framerates of our mode */
+  for (i = 0; i < gst_caps_get_size (caps); i++) {
+    GstStructure *s = gst_caps_get_structure (caps, i);
+
+    if (src->variable_framerate) {
+      gst_structure_set (s, "framerate", GST_TYPE_FRACTION, 0, 1,
+          "max-framerate", GST_TYPE_FRACTION_RANGE, 1, 1, CEF_SRC_MAX_PAINT_RATE, 1, nullptr);
+    } else {
+      gst_structure_set (s, "framerate", GST_TYPE_FRACTION_RANGE, 1, 1, CEF_SRC_MAX_FPS, 1, nullptr);
+    }
+  }
+
+  if (filter) {
+    tmp = gst_caps_intersect_full (filter, caps, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (caps);
+    caps = tmp;
+  }
+
+  return caps;
+}
+
 static GstCaps *
 gst_cef_src_fixate (GstBaseSrc * base_src, GstCaps * caps)
 {
@@ -1049,6 +2816,8 @@ gst_cef_src_fixate (GstBaseSrc * base_src, GstCaps * caps)
   else
     gst_structure_set (structure, "framerate", GST_TYPE_FRACTION, DEFAULT_FPS_N, DEFAULT_FPS_D, nullptr);
 
+  if (gst_structure_has_field (structure, "max-framerate"))
+    gst_structure_fixate_field_nearest_fraction (structure, "max-framerate", DEFAULT_FPS_N, DEFAULT_FPS_D);
 
   caps = GST_BASE_SRC_CLASS (parent_class)->fixate (base_src, caps);
 
@@ -1062,22 +2831,239 @@ gst_cef_src_set_caps (GstBaseSrc * base_src, GstCaps * caps)
 {
   GstCefSrc *src = GST_CEF_SRC (base_src);
   gboolean ret = TRUE;
-  GstBuffer *new_buffer;
+  gint paint_rate;
 
   GST_INFO_OBJECT (base_src, "Caps set to %" GST_PTR_FORMAT, caps);
 
   GST_OBJECT_LOCK (src);
   gst_video_info_from_caps (&src->vinfo, caps);
-  new_buffer = gst_buffer_new_allocate (NULL, src->vinfo.width * src->vinfo.height * 4, NULL);
-  gst_buffer_replace (&(src->current_buffer), new_buffer);
-  gst_buffer_unref (new_buffer);
-  src->browser->GetHost()->SetWindowlessFrameRate(gst_util_uint64_scale (1, src->vinfo.fps_n, src->vinfo.fps_d));
+  if (src->variable_framerate) {
+    GstStructure *s = gst_caps_get_structure (caps, 0);
+
+    if (!gst_structure_get_fraction (s, "max-framerate", &src->vinfo.fps_n, &src->vinfo.fps_d)) {
+      src->vinfo.fps_n = DEFAULT_FPS_N;
+      src->vinfo.fps_d = DEFAULT_FPS_D;
+    }
+  }
+  gst_cef_src_clear_current_buffer (src);
+  paint_rate = gst_cef_src_get_paint_rate (src->vinfo.fps_n, src->vinfo.fps_d, &src->cadence);
+  /* Variable framerate outputs paints as they come, and begin frames
+   * pace rendering when not live */
+  if (src->variable_framerate || !src->is_live)
+    src->cadence = 1;
+  gst_buffer_replace (&src->cadence_frame, NULL);
+  GST_INFO_OBJECT (src, "Painting at %d fps, showing each paint for %u frames",
+      paint_rate, src->cadence);
+  src->browser->GetHost()->SetWindowlessFrameRate(paint_rate);
   src->browser->GetHost()->WasResized();
   GST_OBJECT_UNLOCK (src);
 
   return ret;
 }
 
+/* Memory-less GAP buffers would reach other elements as broken video
+ * frames, only cefdemux knows to take their audio meta */
+static gboolean
+gst_cef_src_query_audio_only_buffers (GstCefSrc *src)
+{
+  GstQuery *query;
+  gboolean ret;
+
+  if (src->audio_mode != CEF_SRC_AUDIO_MODE_IMMEDIATE)
+    return FALSE;
+
+  query = gst_query_new_custom (GST_QUERY_CUSTOM,
+      gst_structure_new_empty ("cef-audio-only-buffers"));
+  ret = gst_pad_peer_query (GST_BASE_SRC_PAD (src), query);
+  gst_query_unref (query);
+
+  if (!ret)
+    GST_WARNING_OBJECT (src, "audio-mode=immediate needs cefdemux downstream, "
+        "sending audio along with video frames instead");
+
+  return ret;
+}
+
+static gboolean
+gst_cef_src_decide_allocation (GstBaseSrc * base_src, GstQuery * query)
+{
+  GstCefSrc *src = GST_CEF_SRC (base_src);
+  GstBufferPool *pool = NULL;
+  GstAllocator *allocator = NULL;
+  GstAllocationParams params;
+  GstStructure *config;
+  GstVideoInfo vinfo;
+  GstCaps *caps;
+  guint size, min, max;
+  gboolean update_pool, update_allocator, video_meta;
+
+  gst_query_parse_allocation (query, &caps, NULL);
+
+  if (!caps || !gst_video_info_from_caps (&vinfo, caps))
+    return FALSE;
+
+  if (gst_query_get_n_allocation_params (query) > 0) {
+    gst_query_parse_nth_allocation_param (query, 0, &allocator, &params);
+    update_allocator = TRUE;
+  } else {
+    gst_allocation_params_init (&params);
+    update_allocator = FALSE;
+  }
+
+  /* Frames in shareable memory cross to other processes through fd
+   * based sinks like unixfdsink without another copy. Keep the fd
+   * allocator downstream proposed, if any. */
+  if (src->fd_memory) {
+#ifdef GST_CEF_SRC_HAVE_FD_MEMORY
+    if (!(allocator && GST_IS_FD_ALLOCATOR (allocator))) {
+      gst_clear_object (&allocator);
+      gst_shm_allocator_init_once ();
+      allocator = gst_shm_allocator_get ();
+      GST_DEBUG_OBJECT (src, "Allocating frames from %" GST_PTR_FORMAT, allocator);
+    }
+#else
+    GST_WARNING_OBJECT (src, "fd-memory needs GStreamer 1.24 or newer on a unix");
+#endif
+  }
+
+  /* Row copies are vectorized, keep them on aligned memory */
+  params.align = MAX (params.align, 31);
+
+  if (gst_query_get_n_allocation_pools (query) > 0) {
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+    size = MAX (size, (guint) vinfo.size);
+    update_pool = TRUE;
+  } else {
+    size = vinfo.size;
+    min = max = 0;
+    update_pool = FALSE;
+  }
+
+  /* The paint handler holds on to CEF_SRC_N_FRAMES frames on top of
+   * what downstream needs */
+  min += CEF_SRC_N_FRAMES;
+  if (max && max < min)
+    max = min;
+
+  if (pool && !GST_IS_VIDEO_BUFFER_POOL (pool)) {
+    GST_DEBUG_OBJECT (src, "Ignoring non-video pool %" GST_PTR_FORMAT, pool);
+    gst_clear_object (&pool);
+  }
+
+  if (!pool)
+    pool = gst_video_buffer_pool_new ();
+
+  video_meta = gst_query_find_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size, min, max);
+  gst_buffer_pool_config_set_allocator (config, allocator, &params);
+
+  if (video_meta) {
+    GstVideoAlignment align;
+
+    gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+
+    /* Honor the alignment of a downstream pool, or pad rows ourselves */
+    if (!gst_buffer_pool_config_has_option (config, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT)) {
+      gst_video_alignment_reset (&align);
+      align.stride_align[0] = 31;
+      gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+      gst_buffer_pool_config_set_video_alignment (config, &align);
+    }
+  }
+
+  if (!gst_buffer_pool_set_config (pool, config)) {
+    config = gst_buffer_pool_get_config (pool);
+
+    if (!gst_buffer_pool_config_validate_params (config, caps, size, min, max)) {
+      gst_structure_free (config);
+      goto config_failed;
+    }
+
+    if (!gst_buffer_pool_set_config (pool, config))
+      goto config_failed;
+  }
+
+  GST_DEBUG_OBJECT (src, "Using pool %" GST_PTR_FORMAT " with video meta: %d", pool, video_meta);
+
+  if (update_allocator)
+    gst_query_set_nth_allocation_param (query, 0, allocator, &params);
+  else
+    gst_query_add_allocation_param (query, allocator, &params);
+
+  if (update_pool)
+    gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+  else
+    gst_query_add_allocation_pool (query, pool, size, min, max);
+
+  gst_clear_object (&allocator);
+
+  src->audio_only_buffers = gst_cef_src_query_audio_only_buffers (src);
+
+  /* The paint handler picks up the new caps along with their pool on
+   * its next paint. Paints at the new size that came before were
+   * skipped, have CEF paint the whole view again. The pool only gets
+   * activated once we return, acquiring from it fails until then. */
+  GST_OBJECT_LOCK (src);
+  gst_object_replace ((GstObject **) &src->alloc_pool, (GstObject *) pool);
+  src->alloc_vinfo = src->vinfo;
+  GST_OBJECT_UNLOCK (src);
+  gst_object_unref (pool);
+  g_atomic_int_inc (&src->caps_cookie);
+
+  if (src->browser)
+    src->browser->GetHost()->Invalidate(PET_VIEW);
+
+  return TRUE;
+
+config_failed:
+  GST_ELEMENT_ERROR (src, RESOURCE, SETTINGS, ("Failed to configure the buffer pool"), (NULL));
+  gst_clear_object (&allocator);
+  gst_object_unref (pool);
+  return FALSE;
+}
+
+static gboolean
+gst_cef_src_apply_setting (GQuark field_id, const GValue *value, GstCefSrc *src)
+{
+  const gchar *name = g_quark_to_string (field_id);
+
+  if (!G_VALUE_HOLDS_STRING (value) ||
+      !g_object_class_find_property (G_OBJECT_GET_CLASS (src), name)) {
+    GST_WARNING_OBJECT (src, "Ignoring setting %s", name);
+    return TRUE;
+  }
+
+  gst_util_set_object_arg (G_OBJECT (src), name, g_value_get_string (value));
+
+  return TRUE;
+}
+
+/* cefbin passes the settings of its helper process cefsrc through the
+ * environment rather than on the command line, and names the variable
+ * with the internal helper-settings-env property so that no other cefsrc
+ * picks them up. The variable is consumed so it does not leak further. */
+static void
+gst_cef_src_apply_settings_env (GstCefSrc *src, const gchar *name)
+{
+  const gchar *env;
+  GstStructure *settings;
+
+  if (!name || !(env = g_getenv (name)))
+    return;
+
+  settings = gst_structure_from_string (env, NULL);
+  if (!settings) {
+    GST_WARNING_OBJECT (src, "Invalid settings in %s: %s", name, env);
+  } else {
+    gst_structure_foreach (settings, (GstStructureForeachFunc) gst_cef_src_apply_setting, src);
+    gst_structure_free (settings);
+  }
+
+  g_unsetenv (name);
+}
+
 static void
 gst_cef_src_set_property (GObject * object, guint prop_id, const GValue * value,
     GParamSpec * pspec)
@@ -1178,6 +3164,49 @@ gst_cef_src_set_property (GObject * object, guint prop_id, const GValue * value,
       src->cef_cache_location = g_value_dup_string (value);
       break;
     }
+    case PROP_DUPLICATE_MODE:
+    {
+      src->duplicate_mode = (CefSrcDuplicateMode) g_value_get_enum (value);
+      break;
+    }
+    case PROP_VARIABLE_FRAMERATE:
+    {
+      src->variable_framerate = g_value_get_boolean (value);
+      break;
+    }
+    case PROP_MIN_FRAMERATE:
+    {
+      src->min_fps_n = gst_value_get_fraction_numerator (value);
+      src->min_fps_d = gst_value_get_fraction_denominator (value);
+      break;
+    }
+    case PROP_IS_LIVE:
+    {
+      src->is_live = g_value_get_boolean (value);
+      gst_base_src_set_live (GST_BASE_SRC (src), src->is_live);
+      break;
+    }
+    case PROP_FD_MEMORY:
+      src->fd_memory = g_value_get_boolean (value);
+      break;
+    case PROP_HELPER_SETTINGS_ENV:
+      gst_cef_src_apply_settings_env (src, g_value_get_string (value));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_atomic_int_set (&src->stats_interval, (gint) g_value_get_uint (value));
+      break;
+    case PROP_AUDIO_MODE:
+    {
+      src->audio_mode = (CefSrcAudioMode) g_value_get_enum (value);
+      break;
+    }
+    case PROP_AUDIO_QUEUE_SIZE:
+      src->audio_queue_size = g_value_get_uint (value);
+      gst_cef_audio_queue_set_size (src->audio_queue, src->audio_queue_size);
+      break;
+    case PROP_AUDIO_OVERFLOW:
+      g_atomic_int_set ((gint *) &src->audio_overflow, g_value_get_enum (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1218,6 +3247,36 @@ gst_cef_src_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_CEF_CACHE_LOCATION:
       g_value_set_string (value, src->cef_cache_location);
       break;
+    case PROP_DUPLICATE_MODE:
+      g_value_set_enum (value, src->duplicate_mode);
+      break;
+    case PROP_VARIABLE_FRAMERATE:
+      g_value_set_boolean (value, src->variable_framerate);
+      break;
+    case PROP_MIN_FRAMERATE:
+      gst_value_set_fraction (value, src->min_fps_n, src->min_fps_d);
+      break;
+    case PROP_IS_LIVE:
+      g_value_set_boolean (value, src->is_live);
+      break;
+    case PROP_FD_MEMORY:
+      g_value_set_boolean (value, src->fd_memory);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_cef_src_get_stats (src));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_uint (value, (guint) g_atomic_int_get (&src->stats_interval));
+      break;
+    case PROP_AUDIO_MODE:
+      g_value_set_enum (value, src->audio_mode);
+      break;
+    case PROP_AUDIO_QUEUE_SIZE:
+      g_value_set_uint (value, src->audio_queue_size);
+      break;
+    case PROP_AUDIO_OVERFLOW:
+      g_value_set_enum (value, g_atomic_int_get ((gint *) &src->audio_overflow));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1229,19 +3288,21 @@ gst_cef_src_finalize (GObject *object)
 {
   GstCefSrc *src = GST_CEF_SRC (object);
 
-  if (src->audio_buffers) {
-    gst_buffer_list_unref (src->audio_buffers);
-    src->audio_buffers = NULL;
-  }
+  gst_cef_audio_queue_free (src->audio_queue);
+  src->audio_queue = NULL;
+  gst_clear_object (&src->alloc_pool);
 
-  g_list_free_full (src->audio_events, (GDestroyNotify) gst_event_unref);
-  src->audio_events = NULL;
+  g_queue_clear_full (&src->audio_events, (GDestroyNotify) gst_event_unref);
+
+  gst_cef_src_release_frames (src);
 
   g_free (src->js_flags);
   g_free (src->cef_cache_location);
 
   g_cond_clear(&src->state_cond);
   g_mutex_clear(&src->state_lock);
+  g_cond_clear(&src->paint_cond);
+  g_mutex_clear(&src->paint_lock);
 }
 
 static void
@@ -1250,9 +3311,35 @@ gst_cef_src_init (GstCefSrc * src)
   GstBaseSrc *base_src = GST_BASE_SRC (src);
 
   src->n_frames = 0;
+  src->cadence = 1;
+  src->cadence_frame = NULL;
   src->current_buffer = NULL;
-  src->audio_buffers = NULL;
-  src->audio_events = NULL;
+  src->caps_cookie = 1;
+  src->paint_cookie = 0;
+  src->paint_generation = 0;
+  src->last_generation = 0;
+  src->n_published = 0;
+  src->n_frames_busy = 0;
+  src->n_repeated = 0;
+  src->n_dropped = 0;
+  src->n_handoff_races = 0;
+  src->paint_pool = NULL;
+  src->back_buffer = NULL;
+  src->popup_pixels = NULL;
+  src->popup_under = NULL;
+  memset (src->frames, 0, sizeof (src->frames));
+  memset (src->frames_stale, 0, sizeof (src->frames_stale));
+  gst_cef_damage_clear (&src->published_damage);
+  src->consumed_generation = 0;
+  src->latest_generation = 0;
+  src->next_frame = 0;
+  gst_video_info_init (&src->paint_vinfo);
+  src->alloc_pool = NULL;
+  gst_video_info_init (&src->alloc_vinfo);
+  src->audio_queue_size = DEFAULT_AUDIO_QUEUE_SIZE;
+  src->audio_overflow = DEFAULT_AUDIO_OVERFLOW;
+  src->audio_queue = gst_cef_audio_queue_new (src->audio_queue_size);
+  g_queue_init (&src->audio_events);
   src->state = CEF_SRC_CLOSED;
   src->chromium_debug_port = DEFAULT_CHROMIUM_DEBUG_PORT;
   src->sandbox = DEFAULT_SANDBOX;
@@ -1260,9 +3347,31 @@ gst_cef_src_init (GstCefSrc * src)
   src->js_flags = NULL;
   src->log_severity = DEFAULT_LOG_SEVERITY;
   src->cef_cache_location = NULL;
+  src->duplicate_mode = DEFAULT_DUPLICATE_MODE;
+  src->clock_id = NULL;
+  src->flushing = FALSE;
+  src->variable_framerate = DEFAULT_VARIABLE_FRAMERATE;
+  src->min_fps_n = DEFAULT_MIN_FPS_N;
+  src->min_fps_d = DEFAULT_MIN_FPS_D;
+  src->last_push_time = -1;
+  src->last_pts = GST_CLOCK_TIME_NONE;
+  src->is_live = DEFAULT_IS_LIVE;
+  src->fd_memory = DEFAULT_FD_MEMORY;
+  src->paint_allocator = NULL;
+  gst_allocation_params_init (&src->paint_params);
+  src->stats_interval = DEFAULT_STATS_INTERVAL;
+  src->audio_mode = DEFAULT_AUDIO_MODE;
+  src->audio_only_buffers = FALSE;
+  src->audio_rate = 0;
+  src->audio_channels = 0;
+  src->audio_enabled = TRUE;
+  src->reported_latency = GST_CLOCK_TIME_NONE;
+  src->last_stats_time = -1;
+  g_mutex_init (&src->paint_lock);
+  g_cond_init (&src->paint_cond);
 
   gst_base_src_set_format (base_src, GST_FORMAT_TIME);
-  gst_base_src_set_live (base_src, TRUE);
+  gst_base_src_set_live (base_src, DEFAULT_IS_LIVE);
 
   g_cond_init (&src->state_cond);
   g_mutex_init (&src->state_lock);
@@ -1338,6 +3447,74 @@ gst_cef_src_class_init (GstCefSrcClass * klass)
           "deprecated: set GST_CEF_CACHE_LOCATION in the environment instead",
           NULL, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
 
+  g_object_class_install_property (gobject_class, PROP_DUPLICATE_MODE,
+      g_param_spec_enum ("duplicate-mode", "duplicate-mode",
+          "How to signal frames repeated because the page did not repaint",
+          GST_TYPE_CEF_DUPLICATE_MODE, DEFAULT_DUPLICATE_MODE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property (gobject_class, PROP_VARIABLE_FRAMERATE,
+    g_param_spec_boolean ("variable-framerate", "variable-framerate",
+          "Only output a frame when the page paints, timestamped with the time it "
+          "was painted at. Caps use framerate=0/1 with a max-framerate",
+          DEFAULT_VARIABLE_FRAMERATE, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property (gobject_class, PROP_MIN_FRAMERATE,
+    gst_param_spec_fraction ("min-framerate", "min-framerate",
+          "In variable framerate mode, repeat the last frame when the page did not "
+          "paint for this long (0/1 = never)",
+          0, 1, 60, 1, DEFAULT_MIN_FPS_N, DEFAULT_MIN_FPS_D,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property (gobject_class, PROP_IS_LIVE,
+    g_param_spec_boolean ("is-live", "is-live",
+          "Render in realtime. When disabled, every output frame is rendered on demand "
+          "with an external begin frame and the page's virtual time advances by one "
+          "frame duration, as fast as the CPU allows",
+          DEFAULT_IS_LIVE, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+    g_param_spec_boxed ("stats", "stats",
+          "Paint, copy, output, latency and audio statistics",
+          GST_TYPE_STRUCTURE, (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+    g_param_spec_uint ("stats-interval", "stats-interval",
+          "Post an element message with the stats every this many milliseconds "
+          "(0 = disabled)", 0, G_MAXINT, DEFAULT_STATS_INTERVAL,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property (gobject_class, PROP_AUDIO_MODE,
+      g_param_spec_enum ("audio-mode", "audio-mode",
+          "When audio leaves the element in live mode. Immediate mode sends it "
+          "in empty buffers between video frames, only cefdemux handles those",
+          GST_TYPE_CEF_AUDIO_MODE, DEFAULT_AUDIO_MODE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property (gobject_class, PROP_AUDIO_QUEUE_SIZE,
+    g_param_spec_uint ("audio-queue-size", "audio-queue-size",
+          "Most audio packets queued while waiting to be output",
+          1, GST_CEF_AUDIO_QUEUE_MAX_SIZE, DEFAULT_AUDIO_QUEUE_SIZE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property (gobject_class, PROP_AUDIO_OVERFLOW,
+      g_param_spec_enum ("audio-overflow", "audio-overflow",
+          "What to do with audio coming in while the queue is full",
+          GST_TYPE_CEF_AUDIO_OVERFLOW, DEFAULT_AUDIO_OVERFLOW,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property (gobject_class, PROP_FD_MEMORY,
+    g_param_spec_boolean ("fd-memory", "fd-memory",
+          "Allocate frames from memfd / shared memory unless downstream proposes "
+          "an fd allocator, so they reach other processes without copies",
+          DEFAULT_FD_MEMORY, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property (gobject_class, PROP_HELPER_SETTINGS_ENV,
+    g_param_spec_string ("helper-settings-env", "helper-settings-env",
+          "Internal, used by cefbin: apply the settings in the named environment "
+          "variable and unset it",
+          NULL, (GParamFlags) (G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
   gst_element_class_set_static_metadata (gstelement_class,
       "Chromium Embedded Framework source", "Source/Video",
       "Creates a video stream from an embedded Chromium browser",
@@ -1346,12 +3523,17 @@ gst_cef_src_class_init (GstCefSrcClass * klass)
   gst_element_class_add_static_pad_template (gstelement_class,
       &gst_cef_src_template);
 
+  base_src_class->get_caps = GST_DEBUG_FUNCPTR(gst_cef_src_get_caps);
   base_src_class->fixate = GST_DEBUG_FUNCPTR(gst_cef_src_fixate);
   base_src_class->set_caps = GST_DEBUG_FUNCPTR(gst_cef_src_set_caps);
+  base_src_class->decide_allocation = GST_DEBUG_FUNCPTR(gst_cef_src_decide_allocation);
   base_src_class->start = GST_DEBUG_FUNCPTR(gst_cef_src_start);
   base_src_class->stop = GST_DEBUG_FUNCPTR(gst_cef_src_stop);
+  base_src_class->unlock = GST_DEBUG_FUNCPTR(gst_cef_src_unlock);
+  base_src_class->unlock_stop = GST_DEBUG_FUNCPTR(gst_cef_src_unlock_stop);
   base_src_class->get_times = GST_DEBUG_FUNCPTR(gst_cef_src_get_times);
   base_src_class->query = GST_DEBUG_FUNCPTR(gst_cef_src_query);
+  base_src_class->event = GST_DEBUG_FUNCPTR(gst_cef_src_event);
 
   gstelement_class->change_state = GST_DEBUG_FUNCPTR(gst_cef_src_change_state);
 
@@ -1,6 +1,8 @@
 #ifndef __GST_CEF_SRC_H__
 #define __GST_CEF_SRC_H__
 
+#include <atomic>
+
 #include "include/cef_browser_process_handler.h"
 #include <gst/gst.h>
 #include <gst/base/gstpushsrc.h>
@@ -12,6 +14,10 @@
 #include <include/cef_load_handler.h>
 #include <include/wrapper/cef_helpers.h>
 
+#include "gstcefaudioqueue.h"
+#include "gstcefconvert.h"
+#include "gstcefdamagemeta.h"
+
 
 G_BEGIN_DECLS
 
@@ -43,13 +49,169 @@ typedef enum : guint8 {
 
 #define CefSrcStateIsOpen(state) (state >= CEF_SRC_OPEN)
 
+typedef enum {
+  // repeated frames are output like any other
+  CEF_SRC_DUPLICATE_MODE_NONE = 0,
+  // repeated frames are flagged GAP and DROPPABLE
+  CEF_SRC_DUPLICATE_MODE_FLAG = 1,
+  // repeated frames are replaced with GAP events
+  CEF_SRC_DUPLICATE_MODE_GAP  = 2,
+} CefSrcDuplicateMode;
+
+typedef enum {
+  // audio is attached to the next video frame
+  CEF_SRC_AUDIO_MODE_FRAME = 0,
+  // audio goes out as soon as it comes in, in empty buffers between frames
+  CEF_SRC_AUDIO_MODE_IMMEDIATE = 1,
+} CefSrcAudioMode;
+
+// highest rate CEF paints windowless browsers at
+#define CEF_SRC_MAX_PAINT_RATE 60
+// highest output framerate, above CEF_SRC_MAX_PAINT_RATE paints get shown
+// for several frames, unless rendering is driven with is-live=false
+#define CEF_SRC_MAX_FPS 240
+
+// below this many damaged pixels, copies stay on the CEF UI thread
+#define CEF_SRC_COPY_STRIPE_MIN_PIXELS (256 * 256)
+
+// number of paint to output latencies the stats percentiles cover
+#define CEF_SRC_N_LATENCY_SAMPLES 256
+// output frames between checks of the measured latency
+#define CEF_SRC_LATENCY_CHECK_INTERVAL 32
+// smoothed drift between CEF audio timestamps and the clock past which
+// the mapping is slowly corrected, at most by CEF_SRC_AUDIO_MAX_SLEW_PPM,
+// and past which it is reset
+#define CEF_SRC_AUDIO_DRIFT_TOLERANCE (5 * GST_MSECOND)
+#define CEF_SRC_AUDIO_MAX_SLEW_PPM 2000
+#define CEF_SRC_AUDIO_RESYNC_THRESHOLD (200 * GST_MSECOND)
+
+// number of output frames recycled by the paint handler
+#define CEF_SRC_N_FRAMES 4
+// past this many rectangles, damage collapses into its bounding box
+#define CEF_SRC_MAX_DAMAGE_RECTS GST_CEF_DAMAGE_META_MAX_RECTS
+
+typedef struct {
+  GstVideoRectangle rects[CEF_SRC_MAX_DAMAGE_RECTS];
+  guint n_rects;
+} GstCefDamage;
+
 struct _GstCefSrc {
   GstPushSrc parent;
+  /* Latest published frame, exchanged atomically between the UI thread
+   * and the streaming thread so neither of them ever waits on the other.
+   * GST_BUFFER_OFFSET carries the paint generation it was published with,
+   * GST_BUFFER_PTS the monotonic time in nanoseconds it was painted at. */
   GstBuffer *current_buffer;
-  GstBufferList *audio_buffers;
-  GList *audio_events;
+  /* Bumped whenever vinfo or the negotiated pool change, so the paint
+   * handler only takes the object lock when it has to */
+  gint caps_cookie;
+  gint paint_cookie;
+  guint64 paint_generation;
+  guint64 last_generation;
+  /* Low bits of the last generation create() took, lets the paint handler
+   * restart damage accumulation once the previous frame was consumed */
+  gint consumed_generation;
+  /* Low bits of the generation of the frame in current_buffer */
+  gint latest_generation;
+  /* Handoff statistics, each written from a single thread. Atomic so
+   * the stats property reads them without taking any lock the writers
+   * could wait on. */
+  std::atomic<guint64> n_published;
+  std::atomic<guint64> n_frames_busy;
+  std::atomic<guint64> n_repeated;
+  std::atomic<guint64> n_dropped;
+  std::atomic<guint64> n_handoff_races;
+  /* Paint statistics, written from the CEF UI thread, atomic too */
+  std::atomic<guint64> n_paints;
+  std::atomic<guint64> bytes_copied;
+  std::atomic<guint64> dirty_pixels;
+  std::atomic<guint64> view_pixels;
+  std::atomic<guint64> paint_duration;
+  std::atomic<guint64> paint_duration_max;
+  /* Protected by the object lock */
+  GstClockTime latency_samples[CEF_SRC_N_LATENCY_SAMPLES];
+  guint64 n_latency_samples;
+  /* How long audio packets wait to be attached to a buffer, from the
+   * running time they were stamped with */
+  GstClockTime audio_latency_samples[CEF_SRC_N_LATENCY_SAMPLES];
+  guint64 n_audio_latency_samples;
+  /* Min latency last answered to a latency query, GST_CLOCK_TIME_NONE
+   * once a new query was asked for */
+  GstClockTime reported_latency;
+  /* Milliseconds between stats messages, 0 for none */
+  gint stats_interval;
+  gint64 last_stats_time;
+  /* Only touched from the CEF UI thread (and once it is done painting):
+   * back_buffer always holds the latest composed view, frames are what
+   * gets published, and frames_stale tracks the region of each frame
+   * that lags behind back_buffer. */
+  GstVideoInfo paint_vinfo;
+  GstCefConvertMatrix paint_matrix;
+  GstBufferPool *paint_pool;
+  /* Allocator of paint_pool, for frames allocated when it has none left */
+  GstAllocator *paint_allocator;
+  GstAllocationParams paint_params;
+  GstBuffer *back_buffer;
+  GstBuffer *frames[CEF_SRC_N_FRAMES];
+  GstCefDamage frames_stale[CEF_SRC_N_FRAMES];
+  GstCefDamage published_damage;
+  guint next_frame;
+  /* Popup layer (<select> dropdowns and the like), also UI thread only.
+   * popup_pixels holds what CEF painted for the popup, popup_under the
+   * view pixels it covers, so back_buffer can be restored when it goes. */
+  GstVideoRectangle popup_rect;
+  GstVideoRectangle popup_clip;
+  guint8 *popup_pixels;
+  guint8 *popup_under;
+  /* Audio packets from the CEF audio thread, stream start and stop
+   * events in the object lock protected audio_events */
+  GstCefAudioQueue *audio_queue;
+  guint audio_queue_size;
+  GstCefAudioQueueOverflow audio_overflow;
+  GQueue audio_events;
   GstVideoInfo vinfo;
-  guint64 n_frames;
+  /* Pool decide_allocation() configured and the vinfo it was configured
+   * for, object lock protected. The paint handler only adopts both
+   * together, frames from a pool do not map with other caps. */
+  GstBufferPool *alloc_pool;
+  GstVideoInfo alloc_vinfo;
+  /* Written from the streaming thread only, atomic for the stats */
+  std::atomic<guint64> n_frames;
+  /* Number of output frames each paint is shown for, when the output
+   * framerate exceeds what CEF paints at. cadence_frame holds the frame
+   * being shown meanwhile, only touched from the streaming thread. */
+  guint cadence;
+  GstBuffer *cadence_frame;
+  CefSrcDuplicateMode duplicate_mode;
+  CefSrcAudioMode audio_mode;
+  /* Whether cefdemux answered the cef-audio-only-buffers query on the
+   * last negotiation, immediate audio falls back to per frame without.
+   * Streaming thread only. */
+  gboolean audio_only_buffers;
+  /* What downstream of cefdemux wants CEF to produce, from the last
+   * cef-audio-params event, 0 to let CEF decide. Object lock. */
+  gint audio_rate;
+  gint audio_channels;
+  /* Cleared when nothing consumes cefdemux audio, read atomically by
+   * the audio handler */
+  gint audio_enabled;
+  /* Protected by the object lock, lets unlock() interrupt GAP pacing */
+  GstClockID clock_id;
+  gboolean flushing;
+  /* In variable framerate mode, vinfo carries the max-framerate and
+   * create() waits on paint_cond for the paint handler to publish */
+  gboolean variable_framerate;
+  gint min_fps_n;
+  gint min_fps_d;
+  GMutex paint_lock;
+  GCond paint_cond;
+  gint64 last_push_time;
+  GstClockTime last_pts;
+  /* When not live, create() drives rendering with external begin frames
+   * and advances the page's virtual time by one frame each time */
+  gboolean is_live;
+  /* Allocate frames from shareable fd backed memory */
+  gboolean fd_memory;
   gulong cef_work_id;
   gchar *url;
   gchar *chrome_extra_flags;
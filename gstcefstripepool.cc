@@ -0,0 +1,118 @@
+#include "gstcefstripepool.h"
+
+GST_DEBUG_CATEGORY_STATIC (cef_stripe_pool_debug);
+#define GST_CAT_DEFAULT cef_stripe_pool_debug
+
+struct _GstCefStripePool {
+  GThreadPool *pool;
+  guint n_threads;
+};
+
+typedef struct {
+  GstCefStripeFunc func;
+  gpointer user_data;
+  guint n_stripes;
+  gint remaining;
+  GMutex lock;
+  GCond cond;
+} GstCefStripeJob;
+
+typedef struct {
+  GstCefStripeJob *job;
+  guint stripe;
+} GstCefStripeTask;
+
+static void
+gst_cef_stripe_pool_worker (GstCefStripeTask *task, GstCefStripePool *pool)
+{
+  GstCefStripeJob *job = task->job;
+
+  job->func (task->stripe, job->n_stripes, job->user_data);
+
+  g_mutex_lock (&job->lock);
+  if (--job->remaining == 0)
+    g_cond_signal (&job->cond);
+  g_mutex_unlock (&job->lock);
+}
+
+/* Like the CEF UI thread, the pool is shared by every cefsrc in the
+ * process and never shut down */
+GstCefStripePool *
+gst_cef_stripe_pool_get_default (void)
+{
+  static GstCefStripePool *default_pool = NULL;
+
+  if (g_once_init_enter (&default_pool)) {
+    GstCefStripePool *pool = g_new0 (GstCefStripePool, 1);
+    GError *err = NULL;
+
+    GST_DEBUG_CATEGORY_INIT (cef_stripe_pool_debug, "cefstripepool", 0,
+        "cefsrc stripe worker pool");
+
+    pool->n_threads = MIN (g_get_num_processors (), GST_CEF_STRIPE_POOL_MAX_STRIPES) - 1;
+    if (pool->n_threads) {
+      pool->pool = g_thread_pool_new ((GFunc) gst_cef_stripe_pool_worker, pool,
+          pool->n_threads, FALSE, &err);
+      if (!pool->pool) {
+        GST_WARNING ("Failed to create stripe workers: %s", err->message);
+        g_clear_error (&err);
+        pool->n_threads = 0;
+      }
+    }
+
+    GST_INFO ("Using %u stripe workers", pool->n_threads);
+
+    g_once_init_leave (&default_pool, pool);
+  }
+
+  return default_pool;
+}
+
+/* Number of stripes that can run concurrently, the calling thread included */
+guint
+gst_cef_stripe_pool_get_n_threads (GstCefStripePool *pool)
+{
+  return pool->n_threads + 1;
+}
+
+/* Calls @func for every stripe, spreading them over the workers and the
+ * calling thread, and returns once all of them are done */
+void
+gst_cef_stripe_pool_run (GstCefStripePool *pool, guint n_stripes,
+    GstCefStripeFunc func, gpointer user_data)
+{
+  GstCefStripeTask tasks[GST_CEF_STRIPE_POOL_MAX_STRIPES];
+  GstCefStripeJob job;
+  guint i;
+
+  n_stripes = CLAMP (n_stripes, 1, GST_CEF_STRIPE_POOL_MAX_STRIPES);
+
+  if (n_stripes == 1 || !pool->pool) {
+    for (i = 0; i < n_stripes; i++)
+      func (i, n_stripes, user_data);
+    return;
+  }
+
+  job.func = func;
+  job.user_data = user_data;
+  job.n_stripes = n_stripes;
+  job.remaining = n_stripes - 1;
+  g_mutex_init (&job.lock);
+  g_cond_init (&job.cond);
+
+  for (i = 1; i < n_stripes; i++) {
+    tasks[i].job = &job;
+    tasks[i].stripe = i;
+    g_thread_pool_push (pool->pool, &tasks[i], NULL);
+  }
+
+  func (0, n_stripes, user_data);
+
+  g_mutex_lock (&job.lock);
+  while (job.remaining)
+    g_cond_wait (&job.cond, &job.lock);
+  g_mutex_unlock (&job.lock);
+
+  g_mutex_clear (&job.lock);
+  g_cond_clear (&job.cond);
+}
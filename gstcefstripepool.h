@@ -0,0 +1,24 @@
+#ifndef __GST_CEF_STRIPE_POOL_H__
+#define __GST_CEF_STRIPE_POOL_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// never split a job in more stripes than this
+#define GST_CEF_STRIPE_POOL_MAX_STRIPES 16
+
+typedef struct _GstCefStripePool GstCefStripePool;
+
+typedef void (*GstCefStripeFunc) (guint stripe, guint n_stripes, gpointer user_data);
+
+GstCefStripePool * gst_cef_stripe_pool_get_default (void);
+
+guint gst_cef_stripe_pool_get_n_threads (GstCefStripePool *pool);
+
+void gst_cef_stripe_pool_run (GstCefStripePool *pool, guint n_stripes,
+    GstCefStripeFunc func, gpointer user_data);
+
+G_END_DECLS
+
+#endif /* __GST_CEF_STRIPE_POOL_H__ */